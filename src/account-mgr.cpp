@@ -13,6 +13,7 @@
 #include "api/api-error.h"
 #include "api/requests.h"
 #include "rpc/rpc-client.h"
+#include "filebrowser/data-cache.h"
 
 namespace {
 const char *kRepoRelayAddrProperty = "relay-address";
@@ -212,6 +213,8 @@ int AccountManager::removeAccount(const Account& account)
     accounts_.erase(std::remove(accounts_.begin(), accounts_.end(), account),
                     accounts_.end());
 
+    DirentsCacheDB::instance()->removeAccount(account.getSignature());
+
     emit accountsChanged();
 
     return 0;
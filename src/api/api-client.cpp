@@ -1,4 +1,6 @@
 #include <QUrl>
+#include <QTimer>
+#include <QDateTime>
 #include <QtNetwork>
 #include <QSslError>
 #include <QSslConfiguration>
@@ -10,6 +12,10 @@
 #include "ui/ssl-confirm-dialog.h"
 #include "utils/utils.h"
 #include "network-mgr.h"
+#include "buffered-reply.h"
+#include "json-stream-parser.h"
+#include "response-cache.h"
+#include "api-retry.h"
 
 #include "api-client.h"
 
@@ -17,23 +23,91 @@ namespace {
 
 const char *kContentTypeForm = "application/x-www-form-urlencoded";
 const char *kAuthHeader = "Authorization";
+const char *kETagHeader = "ETag";
+const char *kLastModifiedHeader = "Last-Modified";
+const char *kIfNoneMatchHeader = "If-None-Match";
+const char *kIfModifiedSinceHeader = "If-Modified-Since";
 
 const int kMaxRedirects = 3;
 
+const char *kRetryAfterHeader = "Retry-After";
+
+// Each retry takes a token from the budget of its server, and each
+// successful request gives back a fraction of one, so the retries are
+// limited to about a tenth of the requests once the budget is used up.
+const double kMaxRetryTokens = 10.0;
+const double kRetryTokensPerSuccess = 0.1;
+
 bool shouldIgnoreRequestError(const QNetworkReply* reply)
 {
     return reply->url().toString().contains("/api2/events");
 }
 
+bool isTransientNetworkError(QNetworkReply::NetworkError error)
+{
+    switch (error) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::UnknownNetworkError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isTransientHttpError(int code)
+{
+    return code == 429 || code == 502 || code == 503 || code == 504;
+}
+
+QHash<QString, double>& retryTokens()
+{
+    static QHash<QString, double> tokens;
+    return tokens;
+}
+
+bool takeRetryToken(const QString& host)
+{
+    QHash<QString, double>& tokens = retryTokens();
+    double available = tokens.value(host, kMaxRetryTokens);
+    if (available < 1.0) {
+        return false;
+    }
+    tokens[host] = available - 1.0;
+    return true;
+}
+
+void refillRetryTokens(const QString& host)
+{
+    QHash<QString, double>& tokens = retryTokens();
+    QHash<QString, double>::iterator it = tokens.find(host);
+    if (it != tokens.end()) {
+        it.value() = qMin(kMaxRetryTokens, it.value() + kRetryTokensPerSuccess);
+    }
+}
+
 } // namespace
 
 QNetworkAccessManager* SeafileApiClient::na_mgr_ = NULL;
+QHash<QString, SeafileApiClient*> SeafileApiClient::gets_in_flight_;
 
 SeafileApiClient::SeafileApiClient(QObject *parent)
     : QObject(parent),
+      attached_(false),
       reply_(NULL),
-      redirect_count_(0)
+      redirect_count_(0),
+      stream_json_(false),
+      cache_response_(false),
+      max_retries_(0),
+      retries_(0),
+      retry_at_(0)
 {
+    retry_timer_ = new QTimer(this);
+    retry_timer_->setSingleShot(true);
+    connect(retry_timer_, SIGNAL(timeout()), this, SLOT(onRetryTimeout()));
+
     if (!na_mgr_) {
         static QNetworkAccessManager mNetworkAccessManager;
         na_mgr_ = &mNetworkAccessManager;
@@ -43,12 +117,36 @@ SeafileApiClient::SeafileApiClient(QObject *parent)
 
 SeafileApiClient::~SeafileApiClient()
 {
+    if (!coalesce_key_.isEmpty()) {
+        handOverToFollower();
+    }
     if (reply_) {
         reply_->deleteLater();
     }
 }
 
 void SeafileApiClient::get(const QUrl& url)
+{
+    QString key = token_ + " " + url.toString();
+    cache_key_ = key;
+    // the body of a streamed response can't be read from the reply
+    if (stream_json_) {
+        key += " json";
+    }
+    SeafileApiClient *leader = gets_in_flight_.value(key);
+    if (leader != NULL && leader != this) {
+        // the same request is in flight, share its response
+        leader->followers_.push_back(this);
+        attached_ = true;
+        return;
+    }
+
+    coalesce_key_ = key;
+    gets_in_flight_[key] = this;
+    sendGet(url);
+}
+
+void SeafileApiClient::sendGet(const QUrl& url)
 {
     QNetworkRequest request(url);
 
@@ -62,8 +160,54 @@ void SeafileApiClient::get(const QUrl& url)
     //        request.url().toString().toUtf8().data(),
     //        request.rawHeader(kAuthHeader).data());
 
+    cached_body_.clear();
+    response_data_.clear();
+    ResponseCache::Entry entry;
+    if (cache_response_ && ResponseCache::instance()->lookup(cache_key_, &entry)) {
+        if (!entry.etag.isEmpty()) {
+            request.setRawHeader(kIfNoneMatchHeader, entry.etag);
+        }
+        if (!entry.last_modified.isEmpty()) {
+            request.setRawHeader(kIfModifiedSinceHeader, entry.last_modified);
+        }
+        cached_body_ = entry.body;
+    }
+
     reply_ = na_mgr_->get(request);
 
+    if (stream_json_) {
+        json_parser_.reset(new JsonStreamParser);
+        connect(reply_, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    }
+
+    connectReply();
+}
+
+void SeafileApiClient::onReadyRead()
+{
+    // only the body of a successful response is json, leave the others in
+    // the reply
+    int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (json_parser_ && (code / 100) == 2) {
+        QByteArray chunk = reply_->readAll();
+        if (cache_response_) {
+            response_data_.append(chunk);
+        }
+        json_parser_->feed(chunk);
+    }
+}
+
+json_t *SeafileApiClient::takeJSON(json_error_t *error)
+{
+    if (!json_parser_) {
+        return NULL;
+    }
+    QScopedPointer<JsonStreamParser> parser(json_parser_.take());
+    return parser->finish(error);
+}
+
+void SeafileApiClient::connectReply()
+{
     connect(reply_, SIGNAL(sslErrors(const QList<QSslError>&)),
             this, SLOT(onSslErrors(const QList<QSslError>&)));
 
@@ -104,10 +248,7 @@ void SeafileApiClient::deleteResource(const QUrl& url)
 
     reply_ = na_mgr_->deleteResource(request);
 
-    connect(reply_, SIGNAL(sslErrors(const QList<QSslError>&)),
-            this, SLOT(onSslErrors(const QList<QSslError>&)));
-
-    connect(reply_, SIGNAL(finished()), this, SLOT(httpRequestFinished()));
+    connectReply();
 }
 
 void SeafileApiClient::onSslErrors(const QList<QSslError>& errors)
@@ -182,17 +323,24 @@ void SeafileApiClient::onSslErrors(const QList<QSslError>& errors)
 void SeafileApiClient::httpRequestFinished()
 {
     int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((code / 100) != 2) {
+        // nothing is parsed from this response, release the parser thread
+        json_parser_.reset();
+    }
     if (code == 0 && reply_->error() != QNetworkReply::NoError) {
         if (NetworkManager::instance()->shouldRetry(reply_->error())) {
             qWarning("[api] network proxy error, retrying\n");
             resendRequest(reply_->url());
             return;
         }
+        if (isTransientNetworkError(reply_->error()) && retryLater(code)) {
+            return;
+        }
         if (!shouldIgnoreRequestError(reply_)) {
             qWarning("[api] network error for %s: %s\n", toCStr(reply_->url().toString()),
                    reply_->errorString().toUtf8().data());
         }
-        emit networkError(reply_->error(), reply_->errorString());
+        notifyNetworkError(reply_->error(), reply_->errorString());
         return;
     }
 
@@ -200,6 +348,10 @@ void SeafileApiClient::httpRequestFinished()
         return;
     }
 
+    if (isTransientHttpError(code) && retryLater(code)) {
+        return;
+    }
+
     if ((code / 100) == 4 || (code / 100) == 5) {
         if (!shouldIgnoreRequestError(reply_)) {
             qWarning("request failed for %s: status code %d\n",
@@ -207,11 +359,24 @@ void SeafileApiClient::httpRequestFinished()
             qDebug("request failed for %s: %s\n",
                    reply_->url().toString().toUtf8().data(), reply_->readAll().data());
         }
-        emit requestFailed(code);
+        notifyRequestFailed(code);
         return;
     }
 
-    emit requestSuccess(*reply_);
+    refillRetryTokens(reply_->url().host());
+
+    if (json_parser_) {
+        // the rest of the body not fed by onReadyRead yet
+        onReadyRead();
+    }
+
+    QPointer<SeafileApiClient> self(this);
+    notifySuccess(cache_response_ ? cacheResponse(code) : QSharedPointer<BufferedReply::Body>());
+    if (self) {
+        // the request has not used the json, e.g. GetDirentsRequest when
+        // the folder is not modified
+        json_parser_.reset();
+    }
 }
 
 bool SeafileApiClient::handleHttpRedirect()
@@ -223,7 +388,7 @@ bool SeafileApiClient::handleHttpRedirect()
 
     if (redirect_count_++ > kMaxRedirects) {
         // simply treat too many redirects as server side error
-        emit requestFailed(500);
+        notifyRequestFailed(500);
         qWarning("too many redirects for %s\n",
                reply_->url().toString().toUtf8().data());
         return true;
@@ -250,12 +415,14 @@ void SeafileApiClient::resendRequest(const QUrl& url)
     switch (reply_->operation()) {
     case QNetworkAccessManager::GetOperation:
         reply_->deleteLater();
-        get(url);
+        sendGet(url);
         break;
     case QNetworkAccessManager::PostOperation:
+        reply_->deleteLater();
         post(url, body_, false);
         break;
     case QNetworkAccessManager::PutOperation:
+        reply_->deleteLater();
         post(url, body_, true);
         break;
     case QNetworkAccessManager::DeleteOperation:
@@ -270,3 +437,216 @@ void SeafileApiClient::resendRequest(const QUrl& url)
         break;
     }
 }
+
+bool SeafileApiClient::retryLater(int code)
+{
+    if (retries_ >= max_retries_) {
+        return false;
+    }
+
+    int delay = retryBackoffDelay(retries_);
+    if (code == 429 || code == 503) {
+        int retry_after = parseRetryAfter(reply_->rawHeader(kRetryAfterHeader));
+        if (retry_after > kMaxRetryAfterMsecs) {
+            return false;
+        }
+        if (retry_after >= 0) {
+            // still spread the retries of the clients told the same time
+            delay = retry_after + delay / 4;
+        }
+    }
+
+    QString host = reply_->url().host();
+    if (!takeRetryToken(host)) {
+        qWarning("[api] retry budget for %s used up, not retrying\n", toCStr(host));
+        return false;
+    }
+
+    retries_++;
+    retry_url_ = reply_->url();
+    qWarning("[api] request to %s failed (%d), retry %d/%d in %d ms\n",
+             toCStr(retry_url_.toString()), code == 0 ? (int)reply_->error() : code,
+             retries_, max_retries_, delay);
+    retry_timer_->start(delay);
+    retry_at_ = QDateTime::currentMSecsSinceEpoch() + delay;
+    emit waitingToRetry();
+    return true;
+}
+
+void SeafileApiClient::onRetryTimeout()
+{
+    emit readyToRetry();
+}
+
+void SeafileApiClient::retry()
+{
+    resendRequest(retry_url_);
+}
+
+QList<QPointer<SeafileApiClient> > SeafileApiClient::takeFollowers()
+{
+    if (coalesce_key_.isEmpty()) {
+        return QList<QPointer<SeafileApiClient> >();
+    }
+    // the requests sent from now on get a fresh response
+    if (gets_in_flight_.value(coalesce_key_) == this) {
+        gets_in_flight_.remove(coalesce_key_);
+    }
+    coalesce_key_.clear();
+
+    QList<QPointer<SeafileApiClient> > followers = followers_;
+    followers_.clear();
+    return followers;
+}
+
+QSharedPointer<BufferedReply::Body> SeafileApiClient::readBody()
+{
+    QSharedPointer<BufferedReply::Body> body;
+    if (json_parser_) {
+        body.reset(new BufferedReply::Body(response_data_));
+        body->json = takeJSON(&body->error);
+        body->parsed = true;
+        response_data_.clear();
+    } else {
+        body.reset(new BufferedReply::Body(reply_->readAll()));
+    }
+    return body;
+}
+
+QSharedPointer<BufferedReply::Body> SeafileApiClient::cacheResponse(int code)
+{
+    if (code == 304 && !cached_body_.isNull()) {
+        return cached_body_;
+    }
+    if ((code / 100) != 2) {
+        return QSharedPointer<BufferedReply::Body>();
+    }
+
+    ResponseCache::Entry entry;
+    entry.etag = reply_->rawHeader(kETagHeader);
+    entry.last_modified = reply_->rawHeader(kLastModifiedHeader);
+    if (entry.etag.isEmpty() && entry.last_modified.isEmpty()) {
+        // the server can't tell whether it has changed
+        ResponseCache::instance()->remove(cache_key_);
+        return QSharedPointer<BufferedReply::Body>();
+    }
+    entry.body = readBody();
+    ResponseCache::instance()->save(cache_key_, entry);
+    return entry.body;
+}
+
+BufferedReply *SeafileApiClient::bufferReply(const QSharedPointer<BufferedReply::Body>& body,
+                                             QObject *parent)
+{
+    BufferedReply *reply = new BufferedReply(*reply_, body, parent);
+    int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (code == 304 && body == cached_body_) {
+        // the cached body is replayed, as the 200 response it was cached from
+        reply->setStatus(200, "OK");
+    }
+    return reply;
+}
+
+void SeafileApiClient::notifySuccess(QSharedPointer<BufferedReply::Body> body)
+{
+    QList<QPointer<SeafileApiClient> > followers = takeFollowers();
+    if (followers.isEmpty() && body.isNull()) {
+        emit requestSuccess(*reply_);
+        return;
+    }
+
+    // Read the body only once, each client gets its own reply to read it
+    // from. They are all created before any of them is delivered, since the
+    // handlers may delete this client.
+    if (body.isNull()) {
+        body = readBody();
+    }
+    QNetworkReply *own_reply = bufferReply(body, this);
+    QList<QPair<QPointer<SeafileApiClient>, QNetworkReply*> > deliveries;
+    foreach (const QPointer<SeafileApiClient>& follower, followers) {
+        if (follower) {
+            deliveries.push_back(
+                qMakePair(follower, (QNetworkReply *)bufferReply(body, follower)));
+        }
+    }
+
+    QPointer<SeafileApiClient> self(this);
+    for (int i = 0; i < deliveries.size(); i++) {
+        if (deliveries[i].first) {
+            emit deliveries[i].first->requestSuccess(*deliveries[i].second);
+        }
+    }
+    if (self) {
+        emit requestSuccess(*own_reply);
+    }
+}
+
+void SeafileApiClient::notifyNetworkError(const QNetworkReply::NetworkError& error,
+                                          const QString& error_string)
+{
+    QPointer<SeafileApiClient> self(this);
+    foreach (const QPointer<SeafileApiClient>& follower, takeFollowers()) {
+        if (follower) {
+            emit follower->networkError(error, error_string);
+        }
+    }
+    if (self) {
+        emit networkError(error, error_string);
+    }
+}
+
+void SeafileApiClient::notifyRequestFailed(int code)
+{
+    QPointer<SeafileApiClient> self(this);
+    foreach (const QPointer<SeafileApiClient>& follower, takeFollowers()) {
+        if (follower) {
+            emit follower->requestFailed(code);
+        }
+    }
+    if (self) {
+        emit requestFailed(code);
+    }
+}
+
+// The request is still in flight when this client is deleted, let the first
+// attached client take it over, so the others don't need to send it again
+void SeafileApiClient::handOverToFollower()
+{
+    QString key = coalesce_key_;
+    QList<QPointer<SeafileApiClient> > followers = takeFollowers();
+    SeafileApiClient *next = NULL;
+    while (next == NULL && !followers.isEmpty()) {
+        next = followers.takeFirst();
+    }
+    if (next == NULL || reply_ == NULL) {
+        return;
+    }
+
+    reply_->disconnect(this);
+    if (json_parser_) {
+        next->json_parser_.reset(json_parser_.take());
+        connect(reply_, SIGNAL(readyRead()), next, SLOT(onReadyRead()));
+    }
+    next->attached_ = false;
+    next->reply_ = reply_;
+    next->redirect_count_ = redirect_count_;
+    next->retries_ = retries_;
+    if (retry_timer_->isActive()) {
+        next->retry_url_ = retry_url_;
+        next->retry_at_ = retry_at_;
+        next->retry_timer_->start(
+            qMax(0, (int)(retry_at_ - QDateTime::currentMSecsSinceEpoch())));
+    }
+    // the reply was sent with the validators and the json streaming of
+    // this client, handle it the same way
+    next->stream_json_ = stream_json_;
+    next->cache_response_ = cache_response_;
+    next->cache_key_ = cache_key_;
+    next->cached_body_ = cached_body_;
+    next->response_data_ = response_data_;
+    next->coalesce_key_ = key;
+    next->followers_ = followers;
+    next->connectReply();
+    gets_in_flight_[key] = next;
+    reply_ = NULL;
+}
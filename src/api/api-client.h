@@ -1,18 +1,49 @@
 #ifndef SEAFILE_API_CLIENT_H
 #define SEAFILE_API_CLIENT_H
 
+#include <jansson.h>
+
 #include <QString>
 #include <QObject>
 #include <QNetworkReply>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QScopedPointer>
 
 #include "account.h"
 #include "server-repo.h"
+#include "buffered-reply.h"
 
 class QNetworkAccessManager;
 class QSslError;
+class QTimer;
+class JsonStreamParser;
 
 /**
  * SeafileApiClient handles the underlying api mechanism
+ *
+ * Identical GET requests (same url and token) sent while one of them is
+ * still in flight are coalesced: the later clients are attached to the
+ * first one instead of sending their own requests, and the response is
+ * read once and delivered to all of them.
+ *
+ * If streaming json is enabled, the body of a successful GET response is
+ * parsed as json while it is received, and is taken with `takeJSON` instead
+ * of being read from the reply.
+ *
+ * If caching the response is enabled, a GET is sent with the validators of
+ * the response cached for it in ResponseCache, and the cached body is
+ * replayed if the server replies 304 (not modified).
+ *
+ * Requests failed with a transient error (a dropped connection, a timeout,
+ * 429, 502, 503 or 504) are retried up to `max_retries` times, after an
+ * exponential backoff with jitter, or the delay given by the Retry-After
+ * header. The retries to each server are limited by a budget refilled by
+ * the successful requests, so a server which is down or restarting is not
+ * flooded with retries. `waitingToRetry` is emitted when a retry is
+ * planned, and `readyToRetry` once it is due: the retry is only sent when
+ * `retry` is called.
  */
 class SeafileApiClient : public QObject {
     Q_OBJECT
@@ -21,18 +52,35 @@ public:
     SeafileApiClient(QObject *parent=0);
     ~SeafileApiClient();
     void setToken(const QString& token) { token_ = token; };
+    void setStreamJSON(bool stream) { stream_json_ = stream; }
+    void setCacheResponse(bool cache) { cache_response_ = cache; }
+    // Only set it for idempotent requests
+    void setMaxRetries(int max_retries) { max_retries_ = max_retries; }
+    bool hasJSON() const { return !json_parser_.isNull(); }
+    // Wait for the json of the response to be parsed, the caller owns the
+    // returned reference
+    json_t *takeJSON(json_error_t *error);
     void get(const QUrl& url);
     void post(const QUrl& url, const QByteArray& body, bool is_put);
     void deleteResource(const QUrl& url);
+    // Send the request again after readyToRetry
+    void retry();
+    // Whether the GET is attached to an identical one in flight, instead
+    // of being sent
+    bool isAttached() const { return attached_; }
 
 signals:
     void requestSuccess(QNetworkReply& reply);
     void requestFailed(int code);
     void networkError(const QNetworkReply::NetworkError& error, const QString& error_string);
     void sslErrors(QNetworkReply *, const QList<QSslError>&);
+    void waitingToRetry();
+    void readyToRetry();
 
 private slots:
     void httpRequestFinished();
+    void onReadyRead();
+    void onRetryTimeout();
     void onSslErrors(const QList<QSslError>& errors);
 
 private:
@@ -42,8 +90,32 @@ private:
 
     void resendRequest(const QUrl& url);
 
+    bool retryLater(int code);
+
+    void sendGet(const QUrl& url);
+    void connectReply();
+
+    QSharedPointer<BufferedReply::Body> readBody();
+    QSharedPointer<BufferedReply::Body> cacheResponse(int code);
+
+    BufferedReply *bufferReply(const QSharedPointer<BufferedReply::Body>& body,
+                               QObject *parent);
+    QList<QPointer<SeafileApiClient> > takeFollowers();
+    void notifySuccess(QSharedPointer<BufferedReply::Body> body);
+    void notifyNetworkError(const QNetworkReply::NetworkError& error,
+                            const QString& error_string);
+    void notifyRequestFailed(int code);
+    void handOverToFollower();
+
     static QNetworkAccessManager *na_mgr_;
 
+    // the GET requests in flight, by their coalescing keys
+    static QHash<QString, SeafileApiClient*> gets_in_flight_;
+    // set if this client sends a GET which others may be attached to
+    QString coalesce_key_;
+    QList<QPointer<SeafileApiClient> > followers_;
+    bool attached_;
+
     QString token_;
 
     QByteArray body_;
@@ -51,6 +123,23 @@ private:
     QNetworkReply *reply_;
 
     int redirect_count_;
+
+    bool stream_json_;
+    QScopedPointer<JsonStreamParser> json_parser_;
+
+    bool cache_response_;
+    QString cache_key_;
+    // the cached response whose validators are sent with the request
+    QSharedPointer<BufferedReply::Body> cached_body_;
+    // the body of a streamed response, kept to be cached
+    QByteArray response_data_;
+
+    int max_retries_;
+    int retries_;
+    QUrl retry_url_;
+    QTimer *retry_timer_;
+    // when the retry is due, in msecs since the epoch
+    qint64 retry_at_;
 };
 
 #endif  // SEAFILE_API_CLIENT_H
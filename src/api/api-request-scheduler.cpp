@@ -0,0 +1,136 @@
+#include <QDateTime>
+#include <QTimer>
+
+#include "api-request.h"
+
+#include "api-request-scheduler.h"
+
+namespace {
+
+// the number of requests to a server a request may start with, by its
+// priority: interactive, user initiated and background
+const int kMaxRequestsPerHost[] = { 6, 4, 2 };
+
+// A queued request is raised by one priority each time it waits that long,
+// but never to the interactive priority, so it can't take the slots kept
+// for the interactive requests nor be started before them.
+const int kAgingIntervalMsecs = 3000;
+
+QString hostOf(const QUrl& url)
+{
+    return url.host() + ":" + QString::number(url.port(url.scheme() == "https" ? 443 : 80));
+}
+
+int effectivePriority(int priority, qint64 queued_at, qint64 now)
+{
+    if (priority == SeafileApiRequest::PRIORITY_INTERACTIVE) {
+        return priority;
+    }
+    return qMax((int)SeafileApiRequest::PRIORITY_USER_INITIATED,
+                priority - (int)((now - queued_at) / kAgingIntervalMsecs));
+}
+
+} // namespace
+
+SINGLETON_IMPL(ApiRequestScheduler)
+
+ApiRequestScheduler::ApiRequestScheduler()
+{
+    aging_timer_ = new QTimer(this);
+    aging_timer_->setInterval(kAgingIntervalMsecs);
+    connect(aging_timer_, SIGNAL(timeout()), this, SLOT(startRequests()));
+}
+
+ApiRequestScheduler::~ApiRequestScheduler()
+{
+    // The requests may outlive the scheduler at exit, they must not call it
+    // back when they are deleted
+    foreach (SeafileApiRequest *req, running_.keys()) {
+        req->scheduled_ = false;
+    }
+    foreach (const QueuedRequest& queued, queue_) {
+        queued.req->scheduled_ = false;
+    }
+}
+
+void ApiRequestScheduler::schedule(SeafileApiRequest *req)
+{
+    if (running_.contains(req)) {
+        return;
+    }
+
+    req->scheduled_ = true;
+    QueuedRequest queued;
+    queued.req = req;
+    queued.host = hostOf(req->url());
+    queued.priority = req->priority();
+    queued.queued_at = QDateTime::currentMSecsSinceEpoch();
+    queue_.push_back(queued);
+
+    startRequests();
+}
+
+void ApiRequestScheduler::finish(SeafileApiRequest *req)
+{
+    req->scheduled_ = false;
+    QHash<SeafileApiRequest*, QString>::iterator it = running_.find(req);
+    if (it == running_.end()) {
+        for (int i = 0; i < queue_.size(); i++) {
+            if (queue_[i].req == req) {
+                queue_.removeAt(i);
+                break;
+            }
+        }
+        return;
+    }
+
+    QString host = it.value();
+    running_.erase(it);
+    if (--running_per_host_[host] <= 0) {
+        running_per_host_.remove(host);
+    }
+
+    startRequests();
+}
+
+bool ApiRequestScheduler::canStart(const QString& host, int priority) const
+{
+    return running_per_host_.value(host) < kMaxRequestsPerHost[priority];
+}
+
+void ApiRequestScheduler::startRequests()
+{
+    while (!queue_.isEmpty()) {
+        // the startable request of the highest priority, the oldest of
+        // them if there are several
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        int next = -1;
+        int next_priority = 0;
+        for (int i = 0; i < queue_.size(); i++) {
+            const QueuedRequest& queued = queue_[i];
+            int priority = effectivePriority(queued.priority, queued.queued_at, now);
+            if (!canStart(queued.host, priority)) {
+                continue;
+            }
+            if (next < 0 || priority < next_priority) {
+                next = i;
+                next_priority = priority;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+
+        QueuedRequest queued = queue_.takeAt(next);
+        running_[queued.req] = queued.host;
+        running_per_host_[queued.host]++;
+        queued.req->start();
+    }
+
+    // re-examine the queued requests as they are aging
+    if (queue_.isEmpty()) {
+        aging_timer_->stop();
+    } else if (!aging_timer_->isActive()) {
+        aging_timer_->start();
+    }
+}
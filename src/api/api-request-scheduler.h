@@ -0,0 +1,61 @@
+#ifndef SEAFILE_CLIENT_API_REQUEST_SCHEDULER_H
+#define SEAFILE_CLIENT_API_REQUEST_SCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include "utils/singleton.h"
+
+class QTimer;
+class SeafileApiRequest;
+
+/**
+ * Decide when the api requests are sent, so that the requests the user is
+ * waiting for are not held up by the background ones.
+ *
+ * The requests to each server are limited, and the lower the priority of
+ * a request, the fewer of them it may use: the last slots to a server are
+ * kept for the interactive requests. Queued requests are started in the
+ * order of their priorities, and the priority of a queued background
+ * request is raised to the user initiated one after it has waited a while,
+ * so the background requests are never starved. Only the requests which
+ * are interactive to begin with may use the slots kept for them.
+ */
+class ApiRequestScheduler : public QObject {
+    Q_OBJECT
+    SINGLETON_DEFINE(ApiRequestScheduler)
+public:
+    ~ApiRequestScheduler();
+
+    // Start the request now, or as soon as its turn comes
+    void schedule(SeafileApiRequest *req);
+    // The request has finished or is being deleted
+    void finish(SeafileApiRequest *req);
+
+private slots:
+    void startRequests();
+
+private:
+    ApiRequestScheduler();
+    Q_DISABLE_COPY(ApiRequestScheduler)
+
+    struct QueuedRequest {
+        SeafileApiRequest *req;
+        QString host;
+        int priority;
+        qint64 queued_at;
+    };
+
+    bool canStart(const QString& host, int priority) const;
+
+    QList<QueuedRequest> queue_;
+    // the server of each request sent, and the number of them per server
+    QHash<SeafileApiRequest*, QString> running_;
+    QHash<QString, int> running_per_host_;
+
+    QTimer *aging_timer_;
+};
+
+#endif // SEAFILE_CLIENT_API_REQUEST_SCHEDULER_H
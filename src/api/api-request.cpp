@@ -7,21 +7,39 @@
 #include "utils/utils.h"
 #include "api-client.h"
 #include "api-error.h"
+#include "buffered-reply.h"
+#include "api-request-scheduler.h"
 
 #include "api-request.h"
 
+namespace {
+
+const int kDefaultMaxGetRetries = 3;
+
+} // namespace
+
 SeafileApiRequest::SeafileApiRequest(const QUrl& url, Method method,
                                      const QString& token, bool ignore_ssl_errors)
     : url_(url),
       method_(method),
       token_(token),
-      ignore_ssl_errors_(ignore_ssl_errors)
+      ignore_ssl_errors_(ignore_ssl_errors),
+      priority_(PRIORITY_USER_INITIATED),
+      retrying_(false),
+      scheduled_(false)
 {
     api_client_ = new SeafileApiClient;
+    if (method_ == METHOD_GET) {
+        api_client_->setMaxRetries(kDefaultMaxGetRetries);
+    }
 }
 
 SeafileApiRequest::~SeafileApiRequest()
 {
+    // a request which never got a response still holds a slot
+    if (scheduled_) {
+        ApiRequestScheduler::instance()->finish(this);
+    }
     delete api_client_;
 }
 
@@ -37,6 +55,17 @@ void SeafileApiRequest::setFormParam(const QString& name, const QString& value)
 
 void SeafileApiRequest::send()
 {
+    ApiRequestScheduler::instance()->schedule(this);
+}
+
+void SeafileApiRequest::start()
+{
+    if (retrying_) {
+        retrying_ = false;
+        api_client_->retry();
+        return;
+    }
+
     if (token_.size() > 0) {
         api_client_->setToken(token_);
     }
@@ -50,6 +79,11 @@ void SeafileApiRequest::send()
     switch (method_) {
     case METHOD_GET:
         api_client_->get(url_);
+        // it waits for the response of an identical request, which has its
+        // own slot
+        if (api_client_->isAttached()) {
+            ApiRequestScheduler::instance()->finish(this);
+        }
         break;
     case METHOD_DELETE:
         api_client_->deleteResource(url_);
@@ -60,9 +94,24 @@ void SeafileApiRequest::send()
         break;
     default:
         qWarning("unknown method %d\n", method_);
+        ApiRequestScheduler::instance()->finish(this);
         return;
     }
 
+    // connected first, so the scheduler is told before the handlers of the
+    // request may delete it
+    connect(api_client_, SIGNAL(requestSuccess(QNetworkReply&)),
+            this, SLOT(onFinished()));
+    connect(api_client_, SIGNAL(networkError(const QNetworkReply::NetworkError&, const QString&)),
+            this, SLOT(onFinished()));
+    connect(api_client_, SIGNAL(requestFailed(int)),
+            this, SLOT(onFinished()));
+    // the slot is given up while waiting to retry
+    connect(api_client_, SIGNAL(waitingToRetry()),
+            this, SLOT(onFinished()));
+    connect(api_client_, SIGNAL(readyToRetry()),
+            this, SLOT(onReadyToRetry()));
+
     connect(api_client_, SIGNAL(requestSuccess(QNetworkReply&)),
             this, SLOT(requestSuccess(QNetworkReply&)));
 
@@ -77,6 +126,17 @@ void SeafileApiRequest::send()
 
 }
 
+void SeafileApiRequest::onFinished()
+{
+    ApiRequestScheduler::instance()->finish(this);
+}
+
+void SeafileApiRequest::onReadyToRetry()
+{
+    retrying_ = true;
+    ApiRequestScheduler::instance()->schedule(this);
+}
+
 void SeafileApiRequest::onHttpError(int code)
 {
     emit failed(ApiError::fromHttpError(code));
@@ -96,8 +156,32 @@ void SeafileApiRequest::onSslErrors(QNetworkReply* reply, const QList<QSslError>
     }
 }
 
+void SeafileApiRequest::setStreamJSON(bool stream)
+{
+    api_client_->setStreamJSON(stream);
+}
+
+void SeafileApiRequest::setCacheResponse(bool cache)
+{
+    api_client_->setCacheResponse(cache);
+}
+
+void SeafileApiRequest::setMaxRetries(int max_retries)
+{
+    api_client_->setMaxRetries(max_retries);
+}
+
 json_t* SeafileApiRequest::parseJSON(QNetworkReply &reply, json_error_t *error)
 {
+    // the response of a coalesced request is parsed only once
+    BufferedReply *buffered = dynamic_cast<BufferedReply *>(&reply);
+    if (buffered) {
+        return buffered->json(error);
+    }
+    if (api_client_->hasJSON()) {
+        return api_client_->takeJSON(error);
+    }
+
     QByteArray raw = reply.readAll();
     //qWarning("\n%s\n", raw.data());
     json_t *root = json_loads(raw.data(), 0, error);
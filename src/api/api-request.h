@@ -22,6 +22,15 @@ class SeafileApiRequest : public QObject {
     Q_OBJECT
 
 public:
+    enum Priority {
+        // the user is waiting for it, e.g. the dirents of the folder opened
+        PRIORITY_INTERACTIVE = 0,
+        // started by the user, but not holding up the ui
+        PRIORITY_USER_INITIATED,
+        // polling, prefetching and the like
+        PRIORITY_BACKGROUND
+    };
+
     virtual ~SeafileApiRequest();
 
     const QUrl& url() const { return url_; }
@@ -31,9 +40,14 @@ public:
     // set param k-v pair which appears in url-encoded form
     void setFormParam(const QString& name, const QString& value);
 
+    // The request is sent by ApiRequestScheduler, according to its priority
     void send();
     void setIgnoreSslErrors(bool ignore) { ignore_ssl_errors_ = ignore; }
 
+    // Only takes effect if it is set before the request is sent
+    void setPriority(Priority priority) { priority_ = priority; }
+    Priority priority() const { return priority_; }
+
 signals:
     void failed(const ApiError& error);
 
@@ -43,6 +57,10 @@ protected slots:
     void onNetworkError(const QNetworkReply::NetworkError& error, const QString& error_string);
     void onHttpError(int);
 
+private slots:
+    void onFinished();
+    void onReadyToRetry();
+
 protected:
     enum Method {
         // post action, passing urlParam and formParam
@@ -62,6 +80,20 @@ protected:
 
     json_t* parseJSON(QNetworkReply &reply, json_error_t *error);
 
+    // Parse the json of the response while it is received, for the
+    // requests which may get large responses. The body can then only be
+    // read with parseJSON.
+    void setStreamJSON(bool stream);
+
+    // Keep the response to be replayed when the server replies it has not
+    // been modified, for the requests which are polled
+    void setCacheResponse(bool cache);
+
+    // How many times the request is retried after a transient error. GET
+    // requests are retried a few times by default, the others are not,
+    // since they may not be idempotent.
+    void setMaxRetries(int max_retries);
+
     // Used with QScopedPointer for json_t
     struct JsonPointerCustomDeleter {
         static inline void cleanup(json_t *json) {
@@ -72,6 +104,9 @@ protected:
 private:
     Q_DISABLE_COPY(SeafileApiRequest)
 
+    friend class ApiRequestScheduler;
+    void start();
+
     QUrl url_;
     QHash<QString, QString> params_;
     QHash<QString, QString> form_params_;
@@ -80,6 +115,12 @@ private:
     SeafileApiClient* api_client_;
 
     bool ignore_ssl_errors_;
+    Priority priority_;
+    // the request has failed, and is to be sent again once scheduled
+    bool retrying_;
+    // the request is queued or running in ApiRequestScheduler, whose slot
+    // is released when the request is deleted
+    bool scheduled_;
 };
 
 #endif // SEAFILE_API_REQUEST_H
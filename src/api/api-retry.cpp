@@ -0,0 +1,58 @@
+#include <QCoreApplication>
+#include <QLocale>
+#include <QString>
+
+#include "api-retry.h"
+
+namespace {
+
+// A generator of its own, so the jitter neither reseeds nor consumes the
+// sequence of qrand() the rest of the client may rely on
+quint32 nextRandom()
+{
+    static quint32 state = 0;
+    if (state == 0) {
+        state = QDateTime::currentDateTime().toTime_t() ^
+            ((quint32)QCoreApplication::applicationPid() << 16);
+        if (state == 0) {
+            state = 0x9e3779b9;
+        }
+    }
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+} // namespace
+
+int retryBackoffDelay(int retries)
+{
+    int delay = kRetryBaseDelayMsecs << qMin(qMax(retries, 0), 5);
+    delay = qMin(delay, kRetryMaxDelayMsecs);
+    return delay / 2 + nextRandom() % (quint32)(delay / 2 + 1);
+}
+
+int parseRetryAfter(const QByteArray& header, const QDateTime& now)
+{
+    QByteArray value = header.trimmed();
+    if (value.isEmpty()) {
+        return -1;
+    }
+    bool ok;
+    qint64 seconds = value.toLongLong(&ok);
+    if (!ok) {
+        QDateTime date = QLocale::c().toDateTime(
+            QString::fromLatin1(value), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+        if (!date.isValid()) {
+            return -1;
+        }
+        date.setTimeSpec(Qt::UTC);
+        seconds = now.secsTo(date);
+    }
+    if (seconds < 0) {
+        return 0;
+    }
+    return (int)qMin(seconds * 1000, (qint64)kMaxRetryAfterMsecs + 1);
+}
@@ -0,0 +1,24 @@
+#ifndef SEAFILE_CLIENT_API_RETRY_H
+#define SEAFILE_CLIENT_API_RETRY_H
+
+#include <QByteArray>
+#include <QDateTime>
+
+const int kRetryBaseDelayMsecs = 1000;
+const int kRetryMaxDelayMsecs = 30 * 1000;
+// give up instead of waiting longer than that for the server
+const int kMaxRetryAfterMsecs = 5 * 60 * 1000;
+
+// Return a random delay in [d/2, d], where d doubles with each retry up to
+// kRetryMaxDelayMsecs, so the clients which failed together don't retry
+// together
+int retryBackoffDelay(int retries);
+
+// Return the delay in msecs given by the value of a Retry-After header,
+// either in seconds or as a http date, or -1 if it is missing or invalid.
+// The delays longer than kMaxRetryAfterMsecs are returned as
+// kMaxRetryAfterMsecs + 1.
+int parseRetryAfter(const QByteArray& header,
+                    const QDateTime& now = QDateTime::currentDateTime());
+
+#endif // SEAFILE_CLIENT_API_RETRY_H
@@ -0,0 +1,77 @@
+#include <string.h>
+
+#include "buffered-reply.h"
+
+BufferedReply::Body::Body(const QByteArray& data)
+    : data(data),
+      parsed(false),
+      json(NULL)
+{
+    memset(&error, 0, sizeof(error));
+}
+
+BufferedReply::Body::~Body()
+{
+    if (json) {
+        json_decref(json);
+    }
+}
+
+BufferedReply::BufferedReply(const QNetworkReply& reply,
+                             const QSharedPointer<Body>& body,
+                             QObject *parent)
+    : QNetworkReply(parent),
+      body_(body),
+      offset_(0)
+{
+    setRequest(reply.request());
+    setUrl(reply.url());
+    setOperation(reply.operation());
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute,
+                 reply.attribute(QNetworkRequest::HttpStatusCodeAttribute));
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute,
+                 reply.attribute(QNetworkRequest::HttpReasonPhraseAttribute));
+    foreach (const QByteArray& name, reply.rawHeaderList()) {
+        setRawHeader(name, reply.rawHeader(name));
+    }
+
+    open(QIODevice::ReadOnly);
+    setFinished(true);
+}
+
+void BufferedReply::setStatus(int code, const QByteArray& reason)
+{
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, code);
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, reason);
+}
+
+json_t *BufferedReply::json(json_error_t *error)
+{
+    if (!body_->parsed) {
+        body_->json = json_loads(body_->data.constData(), 0, &body_->error);
+        body_->parsed = true;
+    }
+    if (!body_->json) {
+        if (error) {
+            *error = body_->error;
+        }
+        return NULL;
+    }
+    return json_incref(body_->json);
+}
+
+qint64 BufferedReply::bytesAvailable() const
+{
+    return body_->data.size() - offset_ + QIODevice::bytesAvailable();
+}
+
+qint64 BufferedReply::readData(char *data, qint64 maxlen)
+{
+    qint64 len = qMin(maxlen, (qint64)body_->data.size() - offset_);
+    if (len <= 0) {
+        return -1;
+    }
+    memcpy(data, body_->data.constData() + offset_, len);
+    offset_ += len;
+    return len;
+}
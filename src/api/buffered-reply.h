@@ -0,0 +1,55 @@
+#ifndef SEAFILE_CLIENT_API_BUFFERED_REPLY_H
+#define SEAFILE_CLIENT_API_BUFFERED_REPLY_H
+
+#include <jansson.h>
+
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QSharedPointer>
+
+/**
+ * A finished reply whose body is already in memory, so that it can be read
+ * by more than one api request.
+ *
+ * The status code, url and headers are copied from the reply it is created
+ * from. The body, and the json parsed from it, are shared by all the
+ * buffered replies created with the same body, so the json is only parsed
+ * once however many requests read it.
+ */
+class BufferedReply : public QNetworkReply {
+public:
+    struct Body {
+        Body(const QByteArray& data);
+        ~Body();
+
+        const QByteArray data;
+        bool parsed;
+        json_t *json;
+        json_error_t error;
+    };
+
+    BufferedReply(const QNetworkReply& reply,
+                  const QSharedPointer<Body>& body,
+                  QObject *parent=0);
+
+    // Return a new reference to the json of the body, parsed only once
+    json_t *json(json_error_t *error);
+
+    // Override the status copied from the original reply
+    void setStatus(int code, const QByteArray& reason);
+
+    void abort() {}
+    bool isSequential() const { return true; }
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen);
+
+private:
+    Q_DISABLE_COPY(BufferedReply)
+
+    QSharedPointer<Body> body_;
+    qint64 offset_;
+};
+
+#endif // SEAFILE_CLIENT_API_BUFFERED_REPLY_H
@@ -0,0 +1,201 @@
+#include <string.h>
+
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "json-stream-parser.h"
+
+// json_load_callback is available since jansson 2.4
+#if defined(JANSSON_VERSION_HEX) && JANSSON_VERSION_HEX >= 0x020400
+#define HAVE_JSON_LOAD_CALLBACK 1
+#endif
+
+struct JsonStreamParser::State {
+    State()
+        : offset(0),
+          eof(false),
+          cancelled(false),
+          started(false),
+          done(false),
+          json(NULL)
+    {
+        memset(&error, 0, sizeof(error));
+    }
+
+    ~State()
+    {
+        if (json) {
+            json_decref(json);
+        }
+    }
+
+    QMutex mutex;
+    QWaitCondition cond;
+
+    // the chunks not parsed yet, and the offset in the first of them
+    QList<QByteArray> chunks;
+    int offset;
+    bool eof;
+    bool cancelled;
+
+    bool started;
+    bool done;
+    json_t *json;
+    json_error_t error;
+};
+
+namespace {
+
+typedef JsonStreamParser::State State;
+
+// Each parser may block a thread while waiting for its data, so don't share
+// the global pool with the others. The parsers beyond its limit are parsed
+// by JsonStreamParser::finish.
+const int kMaxParserThreads = 4;
+
+QThreadPool *parserPool()
+{
+    // Not deleted on exit, since it would wait for the parsers of the
+    // requests which are still in flight.
+    static QThreadPool *pool = NULL;
+    if (!pool) {
+        pool = new QThreadPool;
+        pool->setMaxThreadCount(kMaxParserThreads);
+    }
+    return pool;
+}
+
+#ifdef HAVE_JSON_LOAD_CALLBACK
+size_t readChunk(void *buffer, size_t buflen, void *data)
+{
+    State *state = (State *)data;
+    QMutexLocker lock(&state->mutex);
+    while (state->chunks.isEmpty() && !state->eof) {
+        state->cond.wait(&state->mutex);
+    }
+    if (state->cancelled) {
+        return (size_t)-1;
+    }
+    if (state->chunks.isEmpty()) {
+        return 0;
+    }
+
+    const QByteArray& chunk = state->chunks.first();
+    size_t len = qMin(buflen, (size_t)(chunk.size() - state->offset));
+    memcpy(buffer, chunk.constData() + state->offset, len);
+    state->offset += len;
+    if (state->offset >= chunk.size()) {
+        state->chunks.removeFirst();
+        state->offset = 0;
+    }
+    return len;
+}
+#endif
+
+void parse(State *state)
+{
+    json_error_t error;
+#ifdef HAVE_JSON_LOAD_CALLBACK
+    json_t *json = json_load_callback(readChunk, state, 0, &error);
+#else
+    QByteArray data;
+    {
+        QMutexLocker lock(&state->mutex);
+        foreach (const QByteArray& chunk, state->chunks) {
+            data.append(chunk);
+        }
+        state->chunks.clear();
+    }
+    json_t *json = json_loadb(data.constData(), data.size(), 0, &error);
+#endif
+
+    QMutexLocker lock(&state->mutex);
+    state->json = json;
+    state->error = error;
+    state->done = true;
+    state->cond.wakeAll();
+}
+
+class ParseTask : public QRunnable {
+public:
+    ParseTask(const QSharedPointer<State>& state) : state_(state) {}
+
+    void run() {
+        {
+            QMutexLocker lock(&state_->mutex);
+            // already parsed by JsonStreamParser::finish
+            if (state_->started) {
+                return;
+            }
+            state_->started = true;
+        }
+        parse(state_.data());
+    }
+
+private:
+    QSharedPointer<State> state_;
+};
+
+} // namespace
+
+JsonStreamParser::JsonStreamParser()
+    : state_(new State)
+{
+#ifdef HAVE_JSON_LOAD_CALLBACK
+    parserPool()->start(new ParseTask(state_));
+#endif
+}
+
+JsonStreamParser::~JsonStreamParser()
+{
+    // let the worker thread stop without waiting for it
+    QMutexLocker lock(&state_->mutex);
+    state_->eof = true;
+    state_->cancelled = true;
+    state_->chunks.clear();
+    state_->cond.wakeAll();
+}
+
+void JsonStreamParser::feed(const QByteArray& chunk)
+{
+    if (chunk.isEmpty()) {
+        return;
+    }
+    QMutexLocker lock(&state_->mutex);
+    state_->chunks.push_back(chunk);
+    state_->cond.wakeAll();
+}
+
+json_t *JsonStreamParser::finish(json_error_t *error)
+{
+    bool parse_here = false;
+    {
+        QMutexLocker lock(&state_->mutex);
+        state_->eof = true;
+        state_->cond.wakeAll();
+        if (!state_->started) {
+            // no thread has been available yet
+            state_->started = true;
+            parse_here = true;
+        } else {
+            while (!state_->done) {
+                state_->cond.wait(&state_->mutex);
+            }
+        }
+    }
+    if (parse_here) {
+        parse(state_.data());
+    }
+
+    QMutexLocker lock(&state_->mutex);
+    if (error) {
+        *error = state_->error;
+    }
+    json_t *json = state_->json;
+    state_->json = NULL;
+    return json;
+}
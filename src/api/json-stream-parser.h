@@ -0,0 +1,41 @@
+#ifndef SEAFILE_CLIENT_API_JSON_STREAM_PARSER_H
+#define SEAFILE_CLIENT_API_JSON_STREAM_PARSER_H
+
+#include <jansson.h>
+
+#include <QByteArray>
+#include <QSharedPointer>
+
+/**
+ * Parse a json document while it is being received.
+ *
+ * The chunks of the document are fed as they arrive, and parsed by
+ * json_load_callback in a worker thread, so that parsing a large response
+ * overlaps with its transfer instead of blocking the GUI thread once the
+ * whole of it is received. The chunks are released as soon as they are
+ * parsed, the document is never buffered as a whole.
+ *
+ * If no worker thread is available, the document is parsed by `finish`
+ * instead.
+ */
+class JsonStreamParser {
+public:
+    JsonStreamParser();
+    ~JsonStreamParser();
+
+    void feed(const QByteArray& chunk);
+
+    // Wait for the rest of the document to be parsed. The caller owns the
+    // returned reference.
+    json_t *finish(json_error_t *error);
+
+    struct State;
+
+private:
+    Q_DISABLE_COPY(JsonStreamParser)
+
+    // shared with the worker thread, which may outlive the parser
+    QSharedPointer<State> state_;
+};
+
+#endif // SEAFILE_CLIENT_API_JSON_STREAM_PARSER_H
@@ -112,6 +112,9 @@ ListReposRequest::ListReposRequest(const Account& account)
     : SeafileApiRequest (account.getAbsoluteUrl(kListReposUrl),
                          SeafileApiRequest::METHOD_GET, account.token)
 {
+    setStreamJSON(true);
+    setCacheResponse(true);
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 void ListReposRequest::requestSuccess(QNetworkReply& reply)
@@ -289,6 +292,7 @@ GetUnseenSeahubNotificationsRequest::GetUnseenSeahubNotificationsRequest(const A
     : SeafileApiRequest (account.getAbsoluteUrl(kUnseenMessagesUrl),
                          SeafileApiRequest::METHOD_GET, account.token)
 {
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 void GetUnseenSeahubNotificationsRequest::requestSuccess(QNetworkReply& reply)
@@ -390,6 +394,7 @@ GetLatestVersionRequest::GetLatestVersionRequest(const QString& client_id,
 {
     setUrlParam("id", client_id.left(8));
     setUrlParam("v", QString(kOsName) + "-" + client_version);
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 void GetLatestVersionRequest::requestSuccess(QNetworkReply& reply)
@@ -420,6 +425,8 @@ GetStarredFilesRequest::GetStarredFilesRequest(const Account& account)
     : SeafileApiRequest (account.getAbsoluteUrl(kStarredFilesUrl),
                          SeafileApiRequest::METHOD_GET, account.token)
 {
+    setCacheResponse(true);
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 void GetStarredFilesRequest::requestSuccess(QNetworkReply& reply)
@@ -445,6 +452,10 @@ GetEventsRequest::GetEventsRequest(const Account& account, int start)
     if (start > 0) {
         setUrlParam("start", QString::number(start));
     }
+    setCacheResponse(true);
+    // polled often enough, a failed poll is simply picked up by the next one
+    setMaxRetries(0);
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 void GetEventsRequest::requestSuccess(QNetworkReply& reply)
@@ -514,6 +525,7 @@ GetAvatarRequest::GetAvatarRequest(const Account& account,
 {
     account_ = account;
     email_ = email;
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 GetAvatarRequest::~GetAvatarRequest()
@@ -559,6 +571,7 @@ void GetAvatarRequest::requestSuccess(QNetworkReply& reply)
     QString url = QUrl::fromPercentEncoding(avatar_url);
 
     fetch_img_req_ = new FetchImageRequest(url);
+    fetch_img_req_->setPriority(PRIORITY_BACKGROUND);
 
     connect(fetch_img_req_, SIGNAL(failed(const ApiError&)),
             this, SIGNAL(failed(const ApiError&)));
@@ -604,6 +617,8 @@ ServerInfoRequest::ServerInfoRequest(const Account& account)
                          SeafileApiRequest::METHOD_GET, account.token),
     account_(account)
 {
+    setCacheResponse(true);
+    setPriority(PRIORITY_BACKGROUND);
 }
 
 void ServerInfoRequest::requestSuccess(QNetworkReply& reply)
@@ -0,0 +1,52 @@
+#include "response-cache.h"
+
+namespace {
+
+const int kMaxCachedResponsesBytes = 16 * 1024 * 1024;
+
+// A json tree takes several times the memory of its text, it is only kept
+// for the small responses, and the large ones are parsed again when they
+// are replayed.
+const int kJsonMemoryFactor = 5;
+const int kMaxKeptJsonBytes = 256 * 1024;
+
+} // namespace
+
+SINGLETON_IMPL(ResponseCache)
+
+ResponseCache::ResponseCache()
+{
+    cache_.setMaxCost(kMaxCachedResponsesBytes);
+}
+
+bool ResponseCache::lookup(const QString& key, Entry *entry)
+{
+    Entry *cached = cache_.object(key);
+    if (cached == NULL) {
+        return false;
+    }
+    *entry = *cached;
+    return true;
+}
+
+void ResponseCache::save(const QString& key, const Entry& entry)
+{
+    Entry *cached = new Entry(entry);
+    int size = entry.body->data.size();
+    int cost = size;
+    if (size > kMaxKeptJsonBytes) {
+        // the data is shared, not copied
+        cached->body = QSharedPointer<BufferedReply::Body>(
+            new BufferedReply::Body(entry.body->data));
+    } else {
+        cost += size * kJsonMemoryFactor;
+    }
+
+    // a response larger than the budget is simply not cached
+    cache_.insert(key, cached, qMax(1, cost));
+}
+
+void ResponseCache::remove(const QString& key)
+{
+    cache_.remove(key);
+}
@@ -0,0 +1,43 @@
+#ifndef SEAFILE_CLIENT_API_RESPONSE_CACHE_H
+#define SEAFILE_CLIENT_API_RESPONSE_CACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QSharedPointer>
+#include <QString>
+
+#include "utils/singleton.h"
+#include "buffered-reply.h"
+
+/**
+ * Keep the last response of the periodically polled api requests, with its
+ * validators (ETag and Last-Modified), so that it is only fetched again
+ * when it has changed.
+ *
+ * The responses are kept in memory only, keyed by the url and the token of
+ * the account they are fetched with, and the least recently used ones are
+ * dropped when the budget is exceeded. The parsed json of a small response
+ * is kept with it, so replaying it does not even parse it again, and is
+ * counted in the budget.
+ */
+class ResponseCache {
+    SINGLETON_DEFINE(ResponseCache)
+
+public:
+    struct Entry {
+        QByteArray etag;
+        QByteArray last_modified;
+        QSharedPointer<BufferedReply::Body> body;
+    };
+
+    bool lookup(const QString& key, Entry *entry);
+    void save(const QString& key, const Entry& entry);
+    void remove(const QString& key);
+
+private:
+    ResponseCache();
+
+    QCache<QString, Entry> cache_;
+};
+
+#endif // SEAFILE_CLIENT_API_RESPONSE_CACHE_H
@@ -12,6 +12,7 @@
 #include "utils/utils.h"
 #include "data-mgr.h"
 #include "tasks.h"
+#include "transfer-journal.h"
 
 #include "auto-update-mgr.h"
 
@@ -34,16 +35,52 @@ AutoUpdateManager::AutoUpdateManager()
 
 void AutoUpdateManager::start()
 {
-    QList<FileCacheDB::CacheEntry> all_files =
-        FileCacheDB::instance()->getAllCachedFiles();
+    // the cached files are read in the writer thread of FileCacheDB
+    connect(FileCacheDB::instance(),
+            SIGNAL(allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)),
+            this, SLOT(onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)));
+    FileCacheDB::instance()->loadAllCachedFiles();
+}
+
+void AutoUpdateManager::onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>& all_files)
+{
+    // The cached files are loaded again by each check of FileCacheManager,
+    // only the first load is for us: the uploads must be restored only once.
+    disconnect(FileCacheDB::instance(),
+               SIGNAL(allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)),
+               this, SLOT(onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)));
+
     foreach (const FileCacheDB::CacheEntry entry, all_files) {
         Account account = seafApplet->accountManager()->getAccountBySignature(
             entry.account_sig);
         if (!account.isValid()) {
-            return;
+            continue;
         }
         watchCachedFile(account, entry.repo_id, entry.path);
     }
+    restoreUploads();
+}
+
+/**
+ * Upload again the modified files whose uploads were interrupted by the
+ * last exit of the applet
+ */
+void AutoUpdateManager::restoreUploads()
+{
+    QList<TransferJournal::Entry> entries =
+        TransferJournal::instance()->getUnfinishedTasks(TransferJournal::Upload);
+    foreach (const TransferJournal::Entry& entry, entries) {
+        if (!watch_infos_.contains(entry.local_path)) {
+            TransferJournal::instance()->removeTask(
+                TransferJournal::Upload, entry.repo_id, entry.path);
+            continue;
+        }
+        qDebug("restore the upload of %s\n", toCStr(entry.local_path));
+        TransferJournal::instance()->removeTask(
+            TransferJournal::Upload, entry.repo_id, entry.path);
+        watcher_.removePath(entry.local_path);
+        uploadModifiedFile(entry.local_path);
+    }
 }
 
 void AutoUpdateManager::watchCachedFile(const Account& account,
@@ -55,10 +92,23 @@ void AutoUpdateManager::watchCachedFile(const Account& account,
         return;
     }
 
+    if (watch_infos_.contains(local_path)) {
+        // the file is watched again once its upload is finished
+        if (!watch_infos_[local_path].uploading) {
+            watcher_.addPath(local_path);
+        }
+        return;
+    }
+
     watcher_.addPath(local_path);
     watch_infos_[local_path] = WatchedFileInfo(account, repo_id, path);
 }
 
+bool AutoUpdateManager::isUploading(const QString& path) const
+{
+    return watch_infos_.value(path).uploading;
+}
+
 void AutoUpdateManager::onFileChanged(const QString& local_path)
 {
 #ifdef Q_OS_MAC
@@ -76,6 +126,11 @@ void AutoUpdateManager::onFileChanged(const QString& local_path)
         return;
     }
 
+    uploadModifiedFile(local_path);
+}
+
+void AutoUpdateManager::uploadModifiedFile(const QString& local_path)
+{
     WatchedFileInfo& info = watch_infos_[local_path];
 
     LocalRepo repo;
@@ -92,6 +147,15 @@ void AutoUpdateManager::onFileChanged(const QString& local_path)
     connect(task, SIGNAL(finished(bool)),
             this, SLOT(onUpdateTaskFinished(bool)));
 
+    TransferJournal::Entry entry;
+    entry.type = TransferJournal::Upload;
+    entry.repo_id = info.repo_id;
+    entry.path = info.path_in_repo;
+    entry.local_path = local_path;
+    entry.account_sig = info.account.getSignature();
+    entry.state = TransferJournal::Running;
+    TransferJournal::instance()->saveTask(entry);
+
     task->start();
     info.uploading = true;
 }
@@ -102,7 +166,16 @@ void AutoUpdateManager::onUpdateTaskFinished(bool success)
     if (task == NULL)
         return;
     const QString local_path = task->localFilePath();
+    const QString path_in_repo = watch_infos_.value(local_path).path_in_repo;
     if (success) {
+        TransferJournal::instance()->setTaskState(
+            TransferJournal::Upload, task->repoId(), path_in_repo,
+            TransferJournal::Finished);
+        // the local file is in sync with the server again
+        QFileInfo file_info(local_path);
+        FileCacheDB::instance()->updateCachedFileState(
+            task->repoId(), path_in_repo, file_info.size(),
+            file_info.lastModified().toMSecsSinceEpoch());
         seafApplet->trayIcon()->showMessageWithRepo(task->repoId(),
                                                     tr("Upload Success"),
                                                     tr("File \"%1\"\nuploaded successfully.").arg(QFileInfo(local_path).fileName()));
@@ -115,6 +188,8 @@ void AutoUpdateManager::onUpdateTaskFinished(bool success)
                                                     tr("Upload Failure"),
                                                     tr("File \"%1\"\nfailed to upload.").arg(QFileInfo(local_path).fileName()));
         qDebug("failed to auto update %s\n", toCStr(local_path));
+        TransferJournal::instance()->removeTask(
+            TransferJournal::Upload, task->repoId(), path_in_repo);
         watch_infos_.remove(local_path);
         return;
     }
@@ -18,11 +18,13 @@ public:
     void watchCachedFile(const Account& account,
                          const QString& repo_id,
                          const QString& path);
+    bool isUploading(const QString& path) const;
 
 signals:
     void fileUpdated(const QString& repo_id, const QString& path);
 
 private slots:
+    void onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>& all_files);
     void onFileChanged(const QString& path);
     void onUpdateTaskFinished(bool success);
 
@@ -30,6 +32,8 @@ private:
     AutoUpdateManager();
 
     Account getAccountByRepoId(const QString& repo_id);
+    void restoreUploads();
+    void uploadModifiedFile(const QString& local_path);
 
     QFileSystemWatcher watcher_;
 
@@ -39,13 +43,14 @@ private:
         QString path_in_repo;
         bool uploading;
 
-        WatchedFileInfo() {}
+        WatchedFileInfo() : uploading(false) {}
         WatchedFileInfo(const Account& account,
                  const QString& repo_id,
                  const QString& path_in_repo)
             : account(account),
               repo_id(repo_id),
-              path_in_repo(path_in_repo) {}
+              path_in_repo(path_in_repo),
+              uploading(false) {}
     };
 
     QHash<QString, WatchedFileInfo> watch_infos_;
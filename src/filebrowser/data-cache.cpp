@@ -2,46 +2,170 @@
 #include <sqlite3.h>
 #include <errno.h>
 #include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include <QDateTime>
 #include <QCache>
+#include <QThread>
+#include <QTimer>
+#include <QMutexLocker>
+#include <jansson.h>
 
 #include "utils/file-utils.h"
 #include "utils/utils.h"
 #include "configurator.h"
 #include "seafile-applet.h"
+#include "settings-mgr.h"
 #include "data-cache.h"
 
 namespace {
 
 const int kDirentsCacheExpireTime = 60 * 1000;
 
+// The size of the header of the data of a QString on 64 bit platforms
+const int kQStringDataHeaderSize = 24;
+
+/**
+ * Estimate the bytes of memory used by the cached dirents of a folder,
+ * including its cache key and directory id.
+ */
+int estimateDirentsBytes(const QString& key, const QList<SeafDirent>& dirents)
+{
+    qint64 bytes = sizeof(qint64) + sizeof(QList<SeafDirent>) +
+        2 * kQStringDataHeaderSize + (key.size() + 40) * sizeof(QChar);
+    foreach (const SeafDirent& dirent, dirents) {
+        // QList keeps a pointer to each SeafDirent allocated on the heap
+        bytes += sizeof(void *) + sizeof(SeafDirent);
+        bytes += 2 * kQStringDataHeaderSize +
+            (dirent.id.size() + dirent.name.size()) * sizeof(QChar);
+    }
+    return (int)qMin(bytes, (qint64)INT_MAX);
+}
+
+const int kFileCacheDBFlushDelayMSecs = 500;
+const int kFileCacheDBBusyTimeoutMSecs = 5000;
+
+// The stored dirents are bounded by the size of their json
+const qint64 kMaxDirentsCacheDBBytes = 64 * 1024 * 1024;
+const qint64 kDirentsCacheDBLowWaterBytes = 48 * 1024 * 1024;
+
+void bindText(sqlite3_stmt *stmt, int index, const QString& text)
+{
+    QByteArray utf8 = text.toUtf8();
+    sqlite3_bind_text(stmt, index, utf8.data(), utf8.size(), SQLITE_TRANSIENT);
+}
+
+void readCacheEntry(sqlite3_stmt *stmt, FileCacheDB::CacheEntry *entry)
+{
+    entry->repo_id = (const char *)sqlite3_column_text (stmt, 0);
+    entry->path = QString::fromUtf8((const char *)sqlite3_column_text (stmt, 1));
+    entry->file_id = (const char *)sqlite3_column_text (stmt, 2);
+    entry->account_sig = (const char *)sqlite3_column_text (stmt, 3);
+    entry->size = sqlite3_column_int64 (stmt, 4);
+    entry->mtime = sqlite3_column_int64 (stmt, 5);
+    entry->atime = sqlite3_column_int64 (stmt, 6);
+}
+
+bool sameCacheEntry(const FileCacheDB::CacheEntry& a, const FileCacheDB::CacheEntry& b)
+{
+    return a.file_id == b.file_id && a.account_sig == b.account_sig &&
+        a.size == b.size && a.mtime == b.mtime && a.atime == b.atime;
+}
+
+bool collectColumnName(sqlite3_stmt *stmt, void *data)
+{
+    QStringList *columns = (QStringList *)data;
+    columns->append((const char *)sqlite3_column_text (stmt, 1));
+    return true;
+}
+
+void addColumnIfNotExists(sqlite3 *db, const char *table, const char *column,
+                          const char *definition)
+{
+    QStringList columns;
+    QString sql = QString("PRAGMA table_info(%1)").arg(table);
+    sqlite_foreach_selected_row (db, toCStr(sql), collectColumnName, &columns);
+    if (columns.contains(column)) {
+        return;
+    }
+    sql = QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table).arg(column).arg(definition);
+    sqlite_query_exec (db, toCStr(sql));
+}
+
 } // namespace
 
 SINGLETON_IMPL(DirentsCache)
 DirentsCache::DirentsCache()
+    : hits_(0),
+      misses_(0),
+      evictions_(0)
 {
     cache_ = new QCache<QString, CacheEntry>;
+    setMaxBytes(seafApplet->settingsManager()->direntsCacheSizeMB() * 1024LL * 1024LL);
 }
 DirentsCache::~DirentsCache()
 {
     delete cache_;
 }
 
-QList<SeafDirent>*
-DirentsCache::getCachedDirents(const QString& repo_id,
-                               const QString& path)
+bool DirentsCache::getCachedDirents(const QString& repo_id,
+                                    const QString& path,
+                                    QList<SeafDirent> *dirents)
 {
     QString cache_key = repo_id + path;
     CacheEntry *e = cache_->object(cache_key);
     if (e != NULL) {
         qint64 now = QDateTime::currentMSecsSinceEpoch();
         if (now < e->timestamp + kDirentsCacheExpireTime) {
-            return &(e->dirents);
+            hits_++;
+            *dirents = e->dirents;
+            return true;
+        }
+        // don't let expired entries take up the budget, unless they can
+        // still be revalidated
+        if (e->dir_id.isEmpty()) {
+            cache_->remove(cache_key);
         }
     }
 
-    return NULL;
+    misses_++;
+    return false;
+}
+
+bool DirentsCache::hasCachedDirents(const QString& repo_id,
+                                    const QString& path)
+{
+    CacheEntry *e = cache_->object(repo_id + path);
+    return e != NULL &&
+        QDateTime::currentMSecsSinceEpoch() < e->timestamp + kDirentsCacheExpireTime;
+}
+
+bool DirentsCache::getStaleDirents(const QString& repo_id,
+                                   const QString& path,
+                                   QList<SeafDirent> *dirents,
+                                   QString *dir_id)
+{
+    CacheEntry *e = cache_->object(repo_id + path);
+    if (e == NULL || e->dir_id.isEmpty()) {
+        return false;
+    }
+    *dirents = e->dirents;
+    *dir_id = e->dir_id;
+    return true;
+}
+
+bool DirentsCache::revalidateCachedDirents(const QString& repo_id,
+                                           const QString& path,
+                                           const QString& dir_id)
+{
+    CacheEntry *e = cache_->object(repo_id + path);
+    if (e == NULL || dir_id.isEmpty() || e->dir_id != dir_id) {
+        return false;
+    }
+    e->timestamp = QDateTime::currentMSecsSinceEpoch();
+    return true;
 }
 
 void DirentsCache::expireCachedDirents(const QString& repo_id, const QString& path)
@@ -51,23 +175,591 @@ void DirentsCache::expireCachedDirents(const QString& repo_id, const QString& pa
 
 void DirentsCache::saveCachedDirents(const QString& repo_id,
                                      const QString& path,
-                                     const QList<SeafDirent>& dirents)
+                                     const QList<SeafDirent>& dirents,
+                                     const QString& dir_id)
 {
     CacheEntry *val = new CacheEntry;
     val->timestamp = QDateTime::currentMSecsSinceEpoch();
+    val->dir_id = dir_id;
     val->dirents = dirents;
     QString cache_key = repo_id + path;
-    cache_->insert(cache_key, val);
+
+    // QCache evicts the least recently used entries silently, so count
+    // them by the change of the number of entries
+    int expected_count = cache_->count();
+    if (!cache_->contains(cache_key)) {
+        expected_count++;
+    }
+    // the entry is deleted right away if it exceeds the whole budget
+    cache_->insert(cache_key, val, estimateDirentsBytes(cache_key, dirents));
+    evictions_ += expected_count - cache_->count();
+}
+
+void DirentsCache::setMaxBytes(qint64 max_bytes)
+{
+    int count = cache_->count();
+    cache_->setMaxCost((int)qBound((qint64)1, max_bytes, (qint64)INT_MAX));
+    evictions_ += count - cache_->count();
+}
+
+DirentsCache::Stats DirentsCache::stats() const
+{
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.bytes = cache_->totalCost();
+    stats.max_bytes = cache_->maxCost();
+    stats.entries = cache_->count();
+    return stats;
+}
+
+SINGLETON_IMPL(DirentsCacheDB)
+DirentsCacheDB::DirentsCacheDB()
+{
+    db_ = NULL;
+    get_dirents_stmt_ = NULL;
+    get_all_dirents_stmt_ = NULL;
+    writer_thread_ = NULL;
+    writer_ = NULL;
+    next_seq_ = 0;
+}
+
+DirentsCacheDB::~DirentsCacheDB()
+{
+    stop();
+    if (get_dirents_stmt_ != NULL)
+        sqlite3_finalize(get_dirents_stmt_);
+    if (get_all_dirents_stmt_ != NULL)
+        sqlite3_finalize(get_all_dirents_stmt_);
+    if (db_ != NULL)
+        sqlite3_close(db_);
+}
+
+void DirentsCacheDB::start()
+{
+    const char *errmsg;
+    const char *sql;
+    sqlite3 *db;
+
+    QString db_path = QDir(seafApplet->configurator()->seafileDir()).filePath("dirents-cache.db");
+    if (sqlite3_open (toCStr(db_path), &db)) {
+        errmsg = sqlite3_errmsg (db);
+        qWarning("failed to open dirents cache database %s: %s",
+                 toCStr(db_path), errmsg ? errmsg : "no error given");
+        sqlite3_close(db);
+        // the file browser falls back to the in-memory cache
+        return;
+    }
+
+    sql = "PRAGMA journal_mode=WAL";
+    sqlite_query_exec (db, sql);
+    sql = "PRAGMA synchronous=NORMAL";
+    sqlite_query_exec (db, sql);
+
+    // the stored dirents are only a cache, don't bother upgrading them
+    sql = "DROP TABLE IF EXISTS DirentsCacheV1";
+    sqlite_query_exec (db, sql);
+
+    sql = "CREATE TABLE IF NOT EXISTS DirentsCacheV2 ("
+        "     repo_id VARCHAR(36), "
+        "     path VARCHAR(4096), "
+        "     account_sig VARCHAR(40) NOT NULL, "
+        "     dir_id VARCHAR(40) NOT NULL, "
+        "     size INTEGER NOT NULL, "
+        "     atime INTEGER NOT NULL, "
+        "     dirents TEXT NOT NULL, "
+        "     PRIMARY KEY (repo_id, path))";
+    sqlite_query_exec (db, sql);
+
+    sql = "CREATE INDEX IF NOT EXISTS DirentsCacheV2AtimeIndex ON DirentsCacheV2 (atime)";
+    sqlite_query_exec (db, sql);
+    sql = "CREATE INDEX IF NOT EXISTS DirentsCacheV2AccountIndex ON DirentsCacheV2 (account_sig)";
+    sqlite_query_exec (db, sql);
+
+    sql = "SELECT account_sig, dir_id, dirents FROM DirentsCacheV2"
+        "  WHERE repo_id = ? AND path = ?";
+    get_dirents_stmt_ = sqlite_query_prepare (db, sql);
+
+    sql = "SELECT path, account_sig, dir_id, dirents FROM DirentsCacheV2"
+        "  WHERE repo_id = ?";
+    get_all_dirents_stmt_ = sqlite_query_prepare (db, sql);
+
+    db_ = db;
+
+    writer_thread_ = new QThread;
+    writer_ = new DirentsCacheDBWriter(this, db_path);
+    writer_->moveToThread(writer_thread_);
+    writer_thread_->start();
+}
+
+void DirentsCacheDB::stop()
+{
+    if (writer_thread_ == NULL)
+        return;
+
+    QMetaObject::invokeMethod(writer_, "flush", Qt::BlockingQueuedConnection);
+    writer_thread_->quit();
+    writer_thread_->wait();
+    delete writer_;
+    writer_ = NULL;
+    delete writer_thread_;
+    writer_thread_ = NULL;
+}
+
+bool DirentsCacheDB::getDirents(const QString& repo_id,
+                                const QString& path,
+                                QList<SeafDirent> *dirents,
+                                QString *dir_id)
+{
+    {
+        QMutexLocker lock(&pending_mutex_);
+        QHash<QString, PendingWrite>::const_iterator it =
+            pending_writes_.find(repo_id + path);
+        if (it != pending_writes_.end() && it.value().type != TOUCH_DIRENTS) {
+            if (it.value().type == REMOVE_DIRENTS) {
+                return false;
+            }
+            dirents->append(it.value().dirents);
+            *dir_id = it.value().dir_id;
+            return true;
+        }
+    }
+
+    if (get_dirents_stmt_ == NULL) {
+        return false;
+    }
+    QString account_sig;
+    QString stored_dir_id;
+    QByteArray json;
+    bindText(get_dirents_stmt_, 1, repo_id);
+    bindText(get_dirents_stmt_, 2, path);
+    if (sqlite3_step(get_dirents_stmt_) == SQLITE_ROW) {
+        account_sig = (const char *)sqlite3_column_text (get_dirents_stmt_, 0);
+        stored_dir_id = (const char *)sqlite3_column_text (get_dirents_stmt_, 1);
+        json = (const char *)sqlite3_column_text (get_dirents_stmt_, 2);
+    }
+    sqlite3_reset(get_dirents_stmt_);
+    if (stored_dir_id.isEmpty() || isPurged(account_sig, repo_id)) {
+        return false;
+    }
+
+    json_error_t error;
+    json_t *root = json_loads(json.data(), 0, &error);
+    if (!root) {
+        qWarning("failed to parse the stored dirents of %s: %s\n",
+                 toCStr(path), error.text);
+        removeDirents(repo_id, path);
+        return false;
+    }
+    dirents->append(SeafDirent::listFromJSON(root, &error));
+    json_decref(root);
+    *dir_id = stored_dir_id;
+
+    touchDirents(repo_id, path);
+    return true;
+}
+
+QHash<QString, DirentsCacheDB::Listing>
+DirentsCacheDB::getAllDirents(const QString& repo_id)
+{
+    QHash<QString, Listing> listings;
+    QHash<QString, PendingWrite> pending_writes;
+    {
+        QMutexLocker lock(&pending_mutex_);
+        pending_writes = pending_writes_;
+    }
+
+    if (get_all_dirents_stmt_ != NULL) {
+        bindText(get_all_dirents_stmt_, 1, repo_id);
+        while (sqlite3_step(get_all_dirents_stmt_) == SQLITE_ROW) {
+            QString path = QString::fromUtf8(
+                (const char *)sqlite3_column_text (get_all_dirents_stmt_, 0));
+            QString account_sig =
+                (const char *)sqlite3_column_text (get_all_dirents_stmt_, 1);
+            // the queued writes are newer than the database
+            const PendingWrite *write = NULL;
+            QHash<QString, PendingWrite>::const_iterator it =
+                pending_writes.find(repo_id + path);
+            if (it != pending_writes.end()) {
+                write = &it.value();
+            }
+            if ((write && write->type != TOUCH_DIRENTS) ||
+                isPurged(account_sig, repo_id)) {
+                continue;
+            }
+
+            json_error_t error;
+            json_t *root = json_loads(
+                (const char *)sqlite3_column_text (get_all_dirents_stmt_, 3), 0, &error);
+            if (!root) {
+                qWarning("failed to parse the stored dirents of %s: %s\n",
+                         toCStr(path), error.text);
+                continue;
+            }
+            Listing& listing = listings[path];
+            listing.dir_id = (const char *)sqlite3_column_text (get_all_dirents_stmt_, 2);
+            listing.dirents = SeafDirent::listFromJSON(root, &error);
+            json_decref(root);
+        }
+        sqlite3_reset(get_all_dirents_stmt_);
+    }
+
+    foreach (const PendingWrite& write, pending_writes) {
+        if (write.type == SAVE_DIRENTS && write.repo_id == repo_id) {
+            Listing& listing = listings[write.path];
+            listing.dir_id = write.dir_id;
+            listing.dirents = write.dirents;
+        }
+    }
+    return listings;
+}
+
+void DirentsCacheDB::saveDirents(const QString& account_sig,
+                                 const QString& repo_id,
+                                 const QString& path,
+                                 const QString& dir_id,
+                                 const QList<SeafDirent>& dirents)
+{
+    PendingWrite write;
+    write.type = SAVE_DIRENTS;
+    write.repo_id = repo_id;
+    write.path = path;
+    write.account_sig = account_sig;
+    write.dir_id = dir_id;
+    // shared with the writer, which serializes them
+    write.dirents = dirents;
+    queueWrite(write);
+}
+
+void DirentsCacheDB::removeDirents(const QString& repo_id, const QString& path)
+{
+    PendingWrite write;
+    write.type = REMOVE_DIRENTS;
+    write.repo_id = repo_id;
+    write.path = path;
+    queueWrite(write);
+}
+
+void DirentsCacheDB::touchDirents(const QString& repo_id, const QString& path)
+{
+    PendingWrite write;
+    write.type = TOUCH_DIRENTS;
+    write.repo_id = repo_id;
+    write.path = path;
+    queueWrite(write);
+}
+
+void DirentsCacheDB::queueWrite(PendingWrite write)
+{
+    if (writer_ == NULL) {
+        return;
+    }
+
+    write.atime = QDateTime::currentMSecsSinceEpoch();
+    {
+        QMutexLocker lock(&pending_mutex_);
+        QString key = write.repo_id + write.path;
+        QHash<QString, PendingWrite>::iterator it = pending_writes_.find(key);
+        if (it != pending_writes_.end() && write.type == TOUCH_DIRENTS) {
+            // a queued save is just as recent
+            if (it.value().type != TOUCH_DIRENTS) {
+                return;
+            }
+        }
+        write.seq = next_seq_++;
+        pending_writes_[key] = write;
+    }
+    QMetaObject::invokeMethod(writer_, "flushLater");
+}
+
+void DirentsCacheDB::removeOtherRepos(const QString& account_sig,
+                                      const QStringList& repo_ids)
+{
+    if (writer_ == NULL || account_sig.isEmpty()) {
+        return;
+    }
+
+    PendingPurge purge;
+    purge.account_sig = account_sig;
+    purge.kept_repo_ids = repo_ids;
+    {
+        QMutexLocker lock(&pending_mutex_);
+        QHash<QString, PendingWrite>::iterator it = pending_writes_.begin();
+        while (it != pending_writes_.end()) {
+            if (it.value().account_sig == account_sig &&
+                !repo_ids.contains(it.value().repo_id)) {
+                it = pending_writes_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        pending_purges_.push_back(purge);
+    }
+    QMetaObject::invokeMethod(writer_, "flushLater");
+}
+
+void DirentsCacheDB::removeAccount(const QString& account_sig)
+{
+    removeOtherRepos(account_sig, QStringList());
+}
+
+/**
+ * Whether the stored dirents of the library are to be removed by a queued
+ * purge
+ */
+bool DirentsCacheDB::isPurged(const QString& account_sig, const QString& repo_id)
+{
+    QMutexLocker lock(&pending_mutex_);
+    foreach (const PendingPurge& purge, pending_purges_) {
+        if (purge.account_sig == account_sig &&
+            !purge.kept_repo_ids.contains(repo_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirentsCacheDB::takePendingWrites(QList<PendingWrite> *writes,
+                                       QList<PendingPurge> *purges)
+{
+    QMutexLocker lock(&pending_mutex_);
+    *writes = pending_writes_.values();
+    *purges = pending_purges_;
+}
+
+void DirentsCacheDB::onWritesCommitted(const QList<PendingWrite>& writes, int purges)
+{
+    QMutexLocker lock(&pending_mutex_);
+    foreach (const PendingWrite& write, writes) {
+        // keep the folders which are written again after the batch was taken
+        QHash<QString, PendingWrite>::iterator it =
+            pending_writes_.find(write.repo_id + write.path);
+        if (it != pending_writes_.end() && it.value().seq == write.seq) {
+            pending_writes_.erase(it);
+        }
+    }
+    // the purges queued meanwhile are after the committed ones
+    pending_purges_.erase(pending_purges_.begin(), pending_purges_.begin() + purges);
+}
+
+DirentsCacheDBWriter::DirentsCacheDBWriter(DirentsCacheDB *cache_db,
+                                           const QString& db_path)
+    : cache_db_(cache_db),
+      db_path_(db_path),
+      db_(NULL),
+      save_stmt_(NULL),
+      remove_stmt_(NULL),
+      touch_stmt_(NULL),
+      account_repos_stmt_(NULL),
+      remove_repo_stmt_(NULL),
+      total_size_stmt_(NULL),
+      lru_stmt_(NULL),
+      evict_stmt_(NULL)
+{
+    // moved to the writer thread together with this object
+    flush_timer_ = new QTimer(this);
+    flush_timer_->setSingleShot(true);
+    connect(flush_timer_, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+DirentsCacheDBWriter::~DirentsCacheDBWriter()
+{
+    sqlite3_stmt *stmts[] = { save_stmt_, remove_stmt_, touch_stmt_,
+                              account_repos_stmt_, remove_repo_stmt_,
+                              total_size_stmt_, lru_stmt_, evict_stmt_ };
+    for (size_t i = 0; i < sizeof(stmts) / sizeof(stmts[0]); i++) {
+        if (stmts[i] != NULL)
+            sqlite3_finalize(stmts[i]);
+    }
+    if (db_ != NULL)
+        sqlite3_close(db_);
+}
+
+/**
+ * The connection is opened in the writer thread, the first time it is used
+ */
+bool DirentsCacheDBWriter::open()
+{
+    if (db_ != NULL)
+        return true;
+
+    sqlite3 *db;
+    if (sqlite3_open (toCStr(db_path_), &db)) {
+        const char *errmsg = sqlite3_errmsg (db);
+        qWarning("failed to open dirents cache database %s: %s",
+                 toCStr(db_path_), errmsg ? errmsg : "no error given");
+        sqlite3_close(db);
+        return false;
+    }
+    sqlite_query_exec (db, "PRAGMA synchronous=NORMAL");
+    // wait for the checkpoints of the main thread connection
+    sqlite3_busy_timeout(db, kFileCacheDBBusyTimeoutMSecs);
+
+    save_stmt_ = sqlite_query_prepare (
+        db, "REPLACE INTO DirentsCacheV2 (repo_id, path, account_sig, dir_id, size, atime, dirents)"
+        " VALUES (?, ?, ?, ?, ?, ?, ?)");
+    remove_stmt_ = sqlite_query_prepare (
+        db, "DELETE FROM DirentsCacheV2 WHERE repo_id = ? AND path = ?");
+    touch_stmt_ = sqlite_query_prepare (
+        db, "UPDATE DirentsCacheV2 SET atime = ? WHERE repo_id = ? AND path = ?");
+    account_repos_stmt_ = sqlite_query_prepare (
+        db, "SELECT DISTINCT repo_id FROM DirentsCacheV2 WHERE account_sig = ?");
+    remove_repo_stmt_ = sqlite_query_prepare (
+        db, "DELETE FROM DirentsCacheV2 WHERE account_sig = ? AND repo_id = ?");
+    total_size_stmt_ = sqlite_query_prepare (
+        db, "SELECT SUM(size) FROM DirentsCacheV2");
+    lru_stmt_ = sqlite_query_prepare (
+        db, "SELECT atime, size FROM DirentsCacheV2 ORDER BY atime");
+    evict_stmt_ = sqlite_query_prepare (
+        db, "DELETE FROM DirentsCacheV2 WHERE atime <= ?");
+    db_ = db;
+    return save_stmt_ != NULL && remove_stmt_ != NULL && touch_stmt_ != NULL &&
+        account_repos_stmt_ != NULL && remove_repo_stmt_ != NULL &&
+        total_size_stmt_ != NULL && lru_stmt_ != NULL && evict_stmt_ != NULL;
+}
+
+void DirentsCacheDBWriter::flushLater()
+{
+    if (!flush_timer_->isActive()) {
+        flush_timer_->start(kFileCacheDBFlushDelayMSecs);
+    }
+}
+
+void DirentsCacheDBWriter::flush()
+{
+    flush_timer_->stop();
+
+    QList<DirentsCacheDB::PendingWrite> writes;
+    QList<DirentsCacheDB::PendingPurge> purges;
+    cache_db_->takePendingWrites(&writes, &purges);
+    if ((writes.isEmpty() && purges.isEmpty()) || !open()) {
+        return;
+    }
+
+    bool saved = false;
+    sqlite_query_exec (db_, "BEGIN TRANSACTION");
+    // the writes queued after a purge are not purged by it
+    foreach (const DirentsCacheDB::PendingPurge& p, purges) {
+        purge(p);
+    }
+    foreach (const DirentsCacheDB::PendingWrite& write, writes) {
+        sqlite3_stmt *stmt;
+        if (write.type == DirentsCacheDB::SAVE_DIRENTS) {
+            json_t *array = SeafDirent::listToJSON(write.dirents);
+            char *json = json_dumps(array, JSON_COMPACT);
+            json_decref(array);
+
+            stmt = save_stmt_;
+            bindText(stmt, 1, write.repo_id);
+            bindText(stmt, 2, write.path);
+            bindText(stmt, 3, write.account_sig);
+            bindText(stmt, 4, write.dir_id);
+            sqlite3_bind_int64(stmt, 5, json ? strlen(json) : 0);
+            sqlite3_bind_int64(stmt, 6, write.atime);
+            sqlite3_bind_text(stmt, 7, json ? json : "[]", -1, SQLITE_TRANSIENT);
+            free(json);
+            saved = true;
+        } else if (write.type == DirentsCacheDB::REMOVE_DIRENTS) {
+            stmt = remove_stmt_;
+            bindText(stmt, 1, write.repo_id);
+            bindText(stmt, 2, write.path);
+        } else {
+            stmt = touch_stmt_;
+            sqlite3_bind_int64(stmt, 1, write.atime);
+            bindText(stmt, 2, write.repo_id);
+            bindText(stmt, 3, write.path);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            qWarning("failed to write the stored dirents of %s: %s\n",
+                     toCStr(write.path), sqlite3_errmsg(db_));
+        }
+        sqlite3_reset(stmt);
+    }
+    if (sqlite_query_exec (db_, "COMMIT") < 0) {
+        // keep the writes queued, they are retried by the next flush
+        sqlite_query_exec (db_, "ROLLBACK");
+        return;
+    }
+
+    cache_db_->onWritesCommitted(writes, purges.size());
+
+    if (saved) {
+        evictLeastRecentlyUsed();
+    }
+}
+
+void DirentsCacheDBWriter::purge(const DirentsCacheDB::PendingPurge& purge)
+{
+    QStringList repo_ids;
+    bindText(account_repos_stmt_, 1, purge.account_sig);
+    while (sqlite3_step(account_repos_stmt_) == SQLITE_ROW) {
+        QString repo_id = (const char *)sqlite3_column_text (account_repos_stmt_, 0);
+        if (!purge.kept_repo_ids.contains(repo_id)) {
+            repo_ids.push_back(repo_id);
+        }
+    }
+    sqlite3_reset(account_repos_stmt_);
+
+    foreach (const QString& repo_id, repo_ids) {
+        bindText(remove_repo_stmt_, 1, purge.account_sig);
+        bindText(remove_repo_stmt_, 2, repo_id);
+        sqlite3_step(remove_repo_stmt_);
+        sqlite3_reset(remove_repo_stmt_);
+    }
+}
+
+/**
+ * Remove the least recently used folders once the stored dirents exceed
+ * kMaxDirentsCacheDBBytes, down to kDirentsCacheDBLowWaterBytes so it is
+ * not done again by the next few writes
+ */
+void DirentsCacheDBWriter::evictLeastRecentlyUsed()
+{
+    qint64 total = 0;
+    if (sqlite3_step(total_size_stmt_) == SQLITE_ROW) {
+        total = sqlite3_column_int64(total_size_stmt_, 0);
+    }
+    sqlite3_reset(total_size_stmt_);
+    if (total <= kMaxDirentsCacheDBBytes) {
+        return;
+    }
+
+    qint64 cutoff = -1;
+    while (total > kDirentsCacheDBLowWaterBytes &&
+           sqlite3_step(lru_stmt_) == SQLITE_ROW) {
+        cutoff = sqlite3_column_int64(lru_stmt_, 0);
+        total -= sqlite3_column_int64(lru_stmt_, 1);
+    }
+    sqlite3_reset(lru_stmt_);
+    if (cutoff < 0) {
+        return;
+    }
+
+    sqlite3_bind_int64(evict_stmt_, 1, cutoff);
+    sqlite3_step(evict_stmt_);
+    sqlite3_reset(evict_stmt_);
+    qDebug("removed the least recently used dirents, %d folders\n",
+           sqlite3_changes(db_));
 }
 
 SINGLETON_IMPL(FileCacheDB)
 FileCacheDB::FileCacheDB()
 {
     db_ = NULL;
+    get_entry_stmt_ = NULL;
+    get_by_file_id_stmt_ = NULL;
+    writer_thread_ = NULL;
+    writer_ = NULL;
 }
 
 FileCacheDB::~FileCacheDB()
 {
+    stop();
+    if (get_entry_stmt_ != NULL)
+        sqlite3_finalize(get_entry_stmt_);
+    if (get_by_file_id_stmt_ != NULL)
+        sqlite3_finalize(get_by_file_id_stmt_);
     if (db_ != NULL)
         sqlite3_close(db_);
 }
@@ -88,6 +780,13 @@ void FileCacheDB::start()
         return;
     }
 
+    // readers don't block the writer (and vice versa) in WAL mode, and a
+    // commit only needs to sync the WAL file
+    sql = "PRAGMA journal_mode=WAL";
+    sqlite_query_exec (db, sql);
+    sql = "PRAGMA synchronous=NORMAL";
+    sqlite_query_exec (db, sql);
+
     sql = "DROP TABLE IF EXISTS FileCache";
     sqlite_query_exec (db, sql);
 
@@ -96,20 +795,54 @@ void FileCacheDB::start()
         "     path VARCHAR(4096), "
         "     file_id VARCHAR(40) NOT NULL, "
         "     account_sig VARCHAR(40) NOT NULL, "
+        "     size INTEGER NOT NULL DEFAULT 0, "
+        "     mtime INTEGER NOT NULL DEFAULT 0, "
+        "     atime INTEGER NOT NULL DEFAULT 0, "
         "     PRIMARY KEY (repo_id, path))";
     sqlite_query_exec (db, sql);
 
+    // upgrade the table created by older versions
+    addColumnIfNotExists (db, "FileCacheV1", "size", "INTEGER NOT NULL DEFAULT 0");
+    addColumnIfNotExists (db, "FileCacheV1", "mtime", "INTEGER NOT NULL DEFAULT 0");
+    addColumnIfNotExists (db, "FileCacheV1", "atime", "INTEGER NOT NULL DEFAULT 0");
+
+    sql = "CREATE INDEX IF NOT EXISTS FileCacheV1FileIdIndex ON FileCacheV1 (file_id)";
+    sqlite_query_exec (db, sql);
+
+    sql = "SELECT repo_id, path, file_id, account_sig, size, mtime, atime"
+        "  FROM FileCacheV1"
+        "  WHERE repo_id = ?"
+        "    AND path = ?";
+    get_entry_stmt_ = sqlite_query_prepare (db, sql);
+
+    sql = "SELECT repo_id, path, file_id, account_sig, size, mtime, atime"
+        "  FROM FileCacheV1"
+        "  WHERE file_id = ?";
+    get_by_file_id_stmt_ = sqlite_query_prepare (db, sql);
+
     db_ = db;
+
+    qRegisterMetaType<QList<FileCacheDB::CacheEntry> >("QList<FileCacheDB::CacheEntry>");
+    writer_thread_ = new QThread;
+    writer_ = new FileCacheDBWriter(this, db_path);
+    writer_->moveToThread(writer_thread_);
+    connect(writer_, SIGNAL(allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)),
+            this, SIGNAL(allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)));
+    writer_thread_->start();
 }
 
-bool FileCacheDB::getCacheEntryCB(sqlite3_stmt *stmt, void *data)
+void FileCacheDB::stop()
 {
-    CacheEntry *entry = (CacheEntry *)data;
-    entry->repo_id = (const char *)sqlite3_column_text (stmt, 0);
-    entry->path = QString::fromUtf8((const char *)sqlite3_column_text (stmt, 1));
-    entry->file_id = (const char *)sqlite3_column_text (stmt, 2);
-    entry->account_sig = (const char *)sqlite3_column_text (stmt, 3);
-    return true;
+    if (writer_thread_ == NULL)
+        return;
+
+    QMetaObject::invokeMethod(writer_, "flush", Qt::BlockingQueuedConnection);
+    writer_thread_->quit();
+    writer_thread_->wait();
+    delete writer_;
+    writer_ = NULL;
+    delete writer_thread_;
+    writer_thread_ = NULL;
 }
 
 QString FileCacheDB::getCachedFileId(const QString& repo_id,
@@ -121,41 +854,270 @@ QString FileCacheDB::getCachedFileId(const QString& repo_id,
 FileCacheDB::CacheEntry FileCacheDB::getCacheEntry(const QString& repo_id,
                                                    const QString& path)
 {
-    QString sql = "SELECT repo_id, path, file_id, account_sig"
-        "  FROM FileCacheV1"
-        "  WHERE repo_id = '%1'"
-        "    AND path = '%2'";
-    sql = sql.arg(repo_id).arg(path);
+    {
+        QMutexLocker lock(&pending_mutex_);
+        QHash<QString, PendingWrite>::const_iterator it =
+            pending_writes_.find(repo_id + path);
+        if (it != pending_writes_.end()) {
+            return it.value().removed ? CacheEntry() : it.value().entry;
+        }
+    }
+
     CacheEntry entry;
-    sqlite_foreach_selected_row (db_, toCStr(sql), getCacheEntryCB, &entry);
+    if (get_entry_stmt_ == NULL)
+        return entry;
+
+    bindText(get_entry_stmt_, 1, repo_id);
+    bindText(get_entry_stmt_, 2, path);
+    if (sqlite3_step(get_entry_stmt_) == SQLITE_ROW) {
+        readCacheEntry(get_entry_stmt_, &entry);
+    }
+    sqlite3_reset(get_entry_stmt_);
     return entry;
 }
 
+QList<FileCacheDB::CacheEntry> FileCacheDB::getCacheEntriesByFileId(const QString& file_id)
+{
+    QList<CacheEntry> entries;
+    QHash<QString, PendingWrite> pending_writes;
+    {
+        QMutexLocker lock(&pending_mutex_);
+        pending_writes = pending_writes_;
+    }
+
+    if (get_by_file_id_stmt_ != NULL) {
+        bindText(get_by_file_id_stmt_, 1, file_id);
+        while (sqlite3_step(get_by_file_id_stmt_) == SQLITE_ROW) {
+            CacheEntry entry;
+            readCacheEntry(get_by_file_id_stmt_, &entry);
+            // the queued writes are newer than the database
+            if (!pending_writes.contains(entry.repo_id + entry.path)) {
+                entries.append(entry);
+            }
+        }
+        sqlite3_reset(get_by_file_id_stmt_);
+    }
+
+    foreach (const PendingWrite& write, pending_writes) {
+        if (!write.removed && write.entry.file_id == file_id) {
+            entries.append(write.entry);
+        }
+    }
+    return entries;
+}
+
 void FileCacheDB::saveCachedFileId(const QString& repo_id,
                                    const QString& path,
                                    const QString& file_id,
-                                   const QString& account_sig)
+                                   const QString& account_sig,
+                                   qint64 size,
+                                   qint64 mtime)
+{
+    CacheEntry entry;
+    entry.repo_id = repo_id;
+    entry.path = path;
+    entry.file_id = file_id;
+    entry.account_sig = account_sig;
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.atime = QDateTime::currentMSecsSinceEpoch();
+    queueWrite(entry, false);
+}
+
+void FileCacheDB::touchCachedFile(const QString& repo_id, const QString& path)
+{
+    CacheEntry entry = getCacheEntry(repo_id, path);
+    if (entry.file_id.isEmpty()) {
+        return;
+    }
+    entry.atime = QDateTime::currentMSecsSinceEpoch();
+    queueWrite(entry, false);
+}
+
+void FileCacheDB::updateCachedFileState(const QString& repo_id,
+                                        const QString& path,
+                                        qint64 size,
+                                        qint64 mtime)
 {
-    QString sql = "REPLACE INTO FileCacheV1 VALUES ('%1', '%2', '%3', '%4')";
-    sql = sql.arg(repo_id).arg(path).arg(file_id).arg(account_sig);
-    sqlite_query_exec (db_, toCStr(sql));
+    CacheEntry entry = getCacheEntry(repo_id, path);
+    if (entry.file_id.isEmpty()) {
+        return;
+    }
+    entry.size = size;
+    entry.mtime = mtime;
+    queueWrite(entry, false);
 }
 
-bool FileCacheDB::collectCachedFile(sqlite3_stmt *stmt, void *data)
+void FileCacheDB::removeCachedFile(const QString& repo_id, const QString& path)
 {
-    QList<CacheEntry> *list = (QList<CacheEntry> *)data;
     CacheEntry entry;
-    entry.repo_id = (const char *)sqlite3_column_text (stmt, 0);
-    entry.path = QString::fromUtf8((const char *)sqlite3_column_text (stmt, 1));
-    entry.account_sig = (const char *)sqlite3_column_text (stmt, 2);
-    list->append(entry);
-    return true;
+    entry.repo_id = repo_id;
+    entry.path = path;
+    queueWrite(entry, true);
+}
+
+void FileCacheDB::queueWrite(const CacheEntry& entry, bool removed)
+{
+    if (writer_ == NULL) {
+        qWarning("file cache database is not started, %s is not recorded\n",
+                 toCStr(entry.path));
+        return;
+    }
+
+    PendingWrite write;
+    write.entry = entry;
+    write.removed = removed;
+    {
+        QMutexLocker lock(&pending_mutex_);
+        pending_writes_[entry.repo_id + entry.path] = write;
+    }
+    QMetaObject::invokeMethod(writer_, "flushLater");
+}
+
+void FileCacheDB::loadAllCachedFiles()
+{
+    if (writer_ == NULL) {
+        emit allCachedFilesLoaded(QList<CacheEntry>());
+        return;
+    }
+    QMetaObject::invokeMethod(writer_, "loadAllCachedFiles");
+}
+
+QList<FileCacheDB::PendingWrite> FileCacheDB::pendingWrites()
+{
+    QMutexLocker lock(&pending_mutex_);
+    return pending_writes_.values();
+}
+
+void FileCacheDB::onWritesCommitted(const QList<PendingWrite>& writes)
+{
+    QMutexLocker lock(&pending_mutex_);
+    foreach (const PendingWrite& write, writes) {
+        QString key = write.entry.repo_id + write.entry.path;
+        // keep the entries which are written again after the batch was taken
+        QHash<QString, PendingWrite>::iterator it = pending_writes_.find(key);
+        if (it != pending_writes_.end() &&
+            it.value().removed == write.removed &&
+            sameCacheEntry(it.value().entry, write.entry)) {
+            pending_writes_.erase(it);
+        }
+    }
+}
+
+FileCacheDBWriter::FileCacheDBWriter(FileCacheDB *cache_db, const QString& db_path)
+    : cache_db_(cache_db),
+      db_path_(db_path),
+      db_(NULL),
+      save_stmt_(NULL),
+      remove_stmt_(NULL),
+      all_files_stmt_(NULL)
+{
+    // moved to the writer thread together with this object
+    flush_timer_ = new QTimer(this);
+    flush_timer_->setSingleShot(true);
+    connect(flush_timer_, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+FileCacheDBWriter::~FileCacheDBWriter()
+{
+    if (save_stmt_ != NULL)
+        sqlite3_finalize(save_stmt_);
+    if (remove_stmt_ != NULL)
+        sqlite3_finalize(remove_stmt_);
+    if (all_files_stmt_ != NULL)
+        sqlite3_finalize(all_files_stmt_);
+    if (db_ != NULL)
+        sqlite3_close(db_);
+}
+
+/**
+ * The connection is opened in the writer thread, the first time it is used
+ */
+bool FileCacheDBWriter::open()
+{
+    if (db_ != NULL)
+        return true;
+
+    sqlite3 *db;
+    if (sqlite3_open (toCStr(db_path_), &db)) {
+        const char *errmsg = sqlite3_errmsg (db);
+        qWarning("failed to open file cache database %s: %s",
+                 toCStr(db_path_), errmsg ? errmsg : "no error given");
+        sqlite3_close(db);
+        return false;
+    }
+    sqlite_query_exec (db, "PRAGMA synchronous=NORMAL");
+    // wait for the checkpoints of the main thread connection
+    sqlite3_busy_timeout(db, kFileCacheDBBusyTimeoutMSecs);
+
+    save_stmt_ = sqlite_query_prepare (
+        db, "REPLACE INTO FileCacheV1 (repo_id, path, file_id, account_sig, size, mtime, atime)"
+        " VALUES (?, ?, ?, ?, ?, ?, ?)");
+    remove_stmt_ = sqlite_query_prepare (
+        db, "DELETE FROM FileCacheV1 WHERE repo_id = ? AND path = ?");
+    all_files_stmt_ = sqlite_query_prepare (
+        db, "SELECT repo_id, path, file_id, account_sig, size, mtime, atime FROM FileCacheV1");
+    db_ = db;
+    return save_stmt_ != NULL && remove_stmt_ != NULL && all_files_stmt_ != NULL;
 }
 
-QList<FileCacheDB::CacheEntry> FileCacheDB::getAllCachedFiles()
+void FileCacheDBWriter::flushLater()
 {
-    QString sql = "SELECT repo_id, path, account_sig FROM FileCacheV1";
-    QList<CacheEntry> list;
-    sqlite_foreach_selected_row (db_, toCStr(sql), collectCachedFile, &list);
-    return list;
+    if (!flush_timer_->isActive()) {
+        flush_timer_->start(kFileCacheDBFlushDelayMSecs);
+    }
+}
+
+void FileCacheDBWriter::flush()
+{
+    flush_timer_->stop();
+
+    QList<FileCacheDB::PendingWrite> writes = cache_db_->pendingWrites();
+    if (writes.isEmpty() || !open()) {
+        return;
+    }
+
+    sqlite_query_exec (db_, "BEGIN TRANSACTION");
+    foreach (const FileCacheDB::PendingWrite& write, writes) {
+        const FileCacheDB::CacheEntry& entry = write.entry;
+        sqlite3_stmt *stmt = write.removed ? remove_stmt_ : save_stmt_;
+        bindText(stmt, 1, entry.repo_id);
+        bindText(stmt, 2, entry.path);
+        if (!write.removed) {
+            bindText(stmt, 3, entry.file_id);
+            bindText(stmt, 4, entry.account_sig);
+            sqlite3_bind_int64(stmt, 5, entry.size);
+            sqlite3_bind_int64(stmt, 6, entry.mtime);
+            sqlite3_bind_int64(stmt, 7, entry.atime);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            qWarning("failed to write the file cache entry of %s: %s\n",
+                     toCStr(entry.path), sqlite3_errmsg(db_));
+        }
+        sqlite3_reset(stmt);
+    }
+    if (sqlite_query_exec (db_, "COMMIT") < 0) {
+        // keep the entries queued, they are retried by the next flush
+        sqlite_query_exec (db_, "ROLLBACK");
+        return;
+    }
+
+    cache_db_->onWritesCommitted(writes);
+}
+
+void FileCacheDBWriter::loadAllCachedFiles()
+{
+    // so that the result includes the queued writes
+    flush();
+
+    QList<FileCacheDB::CacheEntry> entries;
+    if (open()) {
+        while (sqlite3_step(all_files_stmt_) == SQLITE_ROW) {
+            FileCacheDB::CacheEntry entry;
+            readCacheEntry(all_files_stmt_, &entry);
+            entries.append(entry);
+        }
+        sqlite3_reset(all_files_stmt_);
+    }
+    emit allCachedFilesLoaded(entries);
 }
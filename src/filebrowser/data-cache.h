@@ -1,76 +1,339 @@
 #ifndef SEAFILE_CLIENT_FILE_BROWSER_DATA_CACHE_H
 #define SEAFILE_CLIENT_FILE_BROWSER_DATA_CACHE_H
 
+#include <QObject>
 #include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
 
 #include "seaf-dirent.h"
 #include "utils/singleton.h"
 
 template<typename Key, typename T> class QCache;
+class QThread;
+class QTimer;
+class FileCacheDBWriter;
+class DirentsCacheDBWriter;
 
 struct sqlite3;
 struct sqlite3_stmt;
 
 /**
  * Cache dirents by (repo_id + path, dirents) in memory
+ *
+ * The id of the directory is kept with its dirents. An expired entry which
+ * has the id is not dropped, so that it can be revalidated with the server
+ * by `GetDirentsRequest` without downloading the dirents again.
+ *
+ * Each entry is charged by the estimated bytes of memory it uses, and the
+ * least recently used entries are evicted once the total exceeds the budget
+ * set by `SettingsManager::direntsCacheSizeMB()`.
  */
 class DirentsCache {
     SINGLETON_DEFINE(DirentsCache)
 public:
-    QList<SeafDirent> *getCachedDirents(const QString& repo_id,
-                                        const QString& path);
+    struct Stats {
+        qint64 hits;
+        qint64 misses;
+        qint64 evictions;
+        qint64 bytes;
+        qint64 max_bytes;
+        int entries;
+    };
+
+    // `dirents` shares the cached list instead of copying it. QList is
+    // implicitly shared, so the cached list is only copied if the caller
+    // modifies its own list, and is never changed by the caller
+    bool getCachedDirents(const QString& repo_id,
+                          const QString& path,
+                          QList<SeafDirent> *dirents);
+    // Like getCachedDirents, but not counted as a hit or miss
+    bool hasCachedDirents(const QString& repo_id, const QString& path);
 
     void expireCachedDirents(const QString& repo_id, const QString& path);
 
+    // Get the dirents even if they have expired, and the id of the directory
+    // to revalidate them with. Not counted as a hit or miss.
+    bool getStaleDirents(const QString& repo_id,
+                         const QString& path,
+                         QList<SeafDirent> *dirents,
+                         QString *dir_id);
+    // The server says the directory is still `dir_id`, so the cached dirents
+    // are valid again. Return false if they are not cached as `dir_id`.
+    bool revalidateCachedDirents(const QString& repo_id,
+                                 const QString& path,
+                                 const QString& dir_id);
+
     void saveCachedDirents(const QString& repo_id,
                            const QString& path,
-                           const QList<SeafDirent>& dirents);
+                           const QList<SeafDirent>& dirents,
+                           const QString& dir_id = QString());
+
+    void setMaxBytes(qint64 max_bytes);
+    Stats stats() const;
 
 private:
     DirentsCache();
     ~DirentsCache();
     struct CacheEntry {
         qint64 timestamp;
+        QString dir_id;
         QList<SeafDirent> dirents;
     };
 
     QCache<QString, CacheEntry> *cache_;
+
+    qint64 hits_;
+    qint64 misses_;
+    qint64 evictions_;
+};
+
+/**
+ * Persist the last known dirents of folders on disk, so that they can be
+ * shown at once the next time the folder is visited, even after a restart,
+ * while the up-to-date dirents are being fetched from the server.
+ * The schema is (repo_id, path, account_sig, dir_id, size, atime, dirents),
+ * where `dirents` is the json of the dirents and `size` its length.
+ *
+ * Like FileCacheDB, reads are done in the main thread with prepared
+ * statements, and writes are queued and committed in batches by a
+ * `DirentsCacheDBWriter`, which also serializes the dirents. The least
+ * recently used folders are removed once the stored dirents exceed a size
+ * bound, and the dirents of removed libraries and accounts are purged.
+ */
+class DirentsCacheDB {
+    SINGLETON_DEFINE(DirentsCacheDB)
+public:
+    struct Listing {
+        QString dir_id;
+        QList<SeafDirent> dirents;
+    };
+
+    void start();
+    // Commit the queued writes and stop the writer thread
+    void stop();
+
+    bool getDirents(const QString& repo_id,
+                    const QString& path,
+                    QList<SeafDirent> *dirents,
+                    QString *dir_id);
+    // Get the stored dirents of all the folders of a library, by path
+    QHash<QString, Listing> getAllDirents(const QString& repo_id);
+    void saveDirents(const QString& account_sig,
+                     const QString& repo_id,
+                     const QString& path,
+                     const QString& dir_id,
+                     const QList<SeafDirent>& dirents);
+    void removeDirents(const QString& repo_id, const QString& path);
+    // Remove the dirents of the libraries of the account which are not in
+    // `repo_ids`, i.e. which the account can't access anymore
+    void removeOtherRepos(const QString& account_sig, const QStringList& repo_ids);
+    void removeAccount(const QString& account_sig);
+
+private:
+    friend class DirentsCacheDBWriter;
+
+    DirentsCacheDB();
+    ~DirentsCacheDB();
+
+    enum WriteType {
+        SAVE_DIRENTS,
+        REMOVE_DIRENTS,
+        // only update the access time
+        TOUCH_DIRENTS
+    };
+
+    struct PendingWrite {
+        WriteType type;
+        QString repo_id;
+        QString path;
+        QString account_sig;
+        QString dir_id;
+        QList<SeafDirent> dirents;
+        qint64 atime;
+        // tells a write from a later one of the same folder
+        qint64 seq;
+    };
+
+    struct PendingPurge {
+        QString account_sig;
+        QStringList kept_repo_ids;
+    };
+
+    void touchDirents(const QString& repo_id, const QString& path);
+    void queueWrite(PendingWrite write);
+    bool isPurged(const QString& account_sig, const QString& repo_id);
+    void takePendingWrites(QList<PendingWrite> *writes,
+                           QList<PendingPurge> *purges);
+    void onWritesCommitted(const QList<PendingWrite>& writes, int purges);
+
+    sqlite3 *db_;
+    sqlite3_stmt *get_dirents_stmt_;
+    sqlite3_stmt *get_all_dirents_stmt_;
+
+    QThread *writer_thread_;
+    DirentsCacheDBWriter *writer_;
+
+    // (repo_id + path) -> queued but not committed write, and the queued
+    // purges in their order
+    QMutex pending_mutex_;
+    QHash<QString, PendingWrite> pending_writes_;
+    QList<PendingPurge> pending_purges_;
+    qint64 next_seq_;
+};
+
+/**
+ * Commit the queued writes of DirentsCacheDB in batches, in its own thread
+ */
+class DirentsCacheDBWriter : public QObject {
+    Q_OBJECT
+public:
+    DirentsCacheDBWriter(DirentsCacheDB *cache_db, const QString& db_path);
+    ~DirentsCacheDBWriter();
+
+public slots:
+    // Commit the queued writes after a short delay, so writes issued close
+    // to each other are committed in the same transaction
+    void flushLater();
+    void flush();
+
+private:
+    bool open();
+    void purge(const DirentsCacheDB::PendingPurge& purge);
+    void evictLeastRecentlyUsed();
+
+    DirentsCacheDB *cache_db_;
+    const QString db_path_;
+    sqlite3 *db_;
+    sqlite3_stmt *save_stmt_;
+    sqlite3_stmt *remove_stmt_;
+    sqlite3_stmt *touch_stmt_;
+    sqlite3_stmt *account_repos_stmt_;
+    sqlite3_stmt *remove_repo_stmt_;
+    sqlite3_stmt *total_size_stmt_;
+    sqlite3_stmt *lru_stmt_;
+    sqlite3_stmt *evict_stmt_;
+    QTimer *flush_timer_;
 };
 
 /**
  * Record the file id of downloaded files.
- * The schema is (repo_id, path, downloaded_file_id)
+ * The schema is (repo_id, path, downloaded_file_id, account_sig, size,
+ * mtime, atime). `size` and `mtime` are of the local file when it was last
+ * in sync with the server, `atime` is the last time the file was used.
+ *
+ * Reads are done in the main thread with prepared statements. Writes are
+ * queued and committed in batches, one transaction per batch, by a
+ * `FileCacheDBWriter` running in its own thread with its own connection.
+ * The database is in WAL mode, so reads are not blocked by the writer.
+ * Queued writes are visible to reads at once.
  */
-class FileCacheDB {
+class FileCacheDB : public QObject {
     SINGLETON_DEFINE(FileCacheDB)
+    Q_OBJECT
 public:
     struct CacheEntry {
         QString repo_id;
         QString path;
         QString file_id;
         QString account_sig;
+        qint64 size;
+        qint64 mtime;
+        qint64 atime;
+
+        CacheEntry() : size(0), mtime(0), atime(0) {}
     };
 
     void start();
+    // Commit the queued writes and stop the writer thread
+    void stop();
 
     QString getCachedFileId(const QString& repo_id,
                             const QString& path);
     CacheEntry getCacheEntry(const QString& repo_id,
                              const QString& path);
+    // Return the cached files of all the paths with the given file id
+    QList<CacheEntry> getCacheEntriesByFileId(const QString& file_id);
     void saveCachedFileId(const QString& repo_id,
                           const QString& path,
                           const QString& file_id,
-                          const QString& account_sig);
+                          const QString& account_sig,
+                          qint64 size,
+                          qint64 mtime);
+    // Record that the cached file is used now
+    void touchCachedFile(const QString& repo_id, const QString& path);
+    // Record that the local file is in sync with the server again
+    void updateCachedFileState(const QString& repo_id,
+                               const QString& path,
+                               qint64 size,
+                               qint64 mtime);
+    void removeCachedFile(const QString& repo_id, const QString& path);
 
-    QList<CacheEntry> getAllCachedFiles();
+    // Read all the cached files in the writer thread,
+    // `allCachedFilesLoaded` is emitted with the result
+    void loadAllCachedFiles();
+
+signals:
+    void allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>& entries);
 
 private:
+    friend class FileCacheDBWriter;
+class DirentsCacheDBWriter;
+
     FileCacheDB();
     ~FileCacheDB();
-    static bool getCacheEntryCB(sqlite3_stmt *stmt, void *data);
-    static bool collectCachedFile(sqlite3_stmt *stmt, void *data);
 
+    struct PendingWrite {
+        CacheEntry entry;
+        bool removed;
+    };
+
+    void queueWrite(const CacheEntry& entry, bool removed);
+    QList<PendingWrite> pendingWrites();
+    void onWritesCommitted(const QList<PendingWrite>& writes);
+
+    sqlite3 *db_;
+    sqlite3_stmt *get_entry_stmt_;
+    sqlite3_stmt *get_by_file_id_stmt_;
+
+    QThread *writer_thread_;
+    FileCacheDBWriter *writer_;
+
+    // (repo_id + path) -> queued but not committed write
+    QMutex pending_mutex_;
+    QHash<QString, PendingWrite> pending_writes_;
+};
+
+/**
+ * Commit the queued writes of FileCacheDB in batches, in its own thread
+ */
+class FileCacheDBWriter : public QObject {
+    Q_OBJECT
+public:
+    FileCacheDBWriter(FileCacheDB *cache_db, const QString& db_path);
+    ~FileCacheDBWriter();
+
+public slots:
+    // Commit the queued writes after a short delay, so writes issued close
+    // to each other are committed in the same transaction
+    void flushLater();
+    void flush();
+    void loadAllCachedFiles();
+
+signals:
+    void allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>& entries);
+
+private:
+    bool open();
+
+    FileCacheDB *cache_db_;
+    const QString db_path_;
     sqlite3 *db_;
+    sqlite3_stmt *save_stmt_;
+    sqlite3_stmt *remove_stmt_;
+    sqlite3_stmt *all_files_stmt_;
+    QTimer *flush_timer_;
 };
 
 
@@ -3,6 +3,7 @@
 #include <sqlite3.h>
 
 #include <QDir>
+#include <QFile>
 #include <QDateTime>
 
 #include "utils/file-utils.h"
@@ -17,12 +18,14 @@
 #include "filebrowser/tasks.h"
 #include "filebrowser/transfer-mgr.h"
 #include "filebrowser/data-cache.h"
+#include "filebrowser/file-cache-mgr.h"
 #include "filebrowser/data-mgr.h"
 
 namespace {
 
 const char *kFileCacheTopDirName = "file-cache";
 const int kPasswordCacheExpirationMSecs = 30 * 60 * 1000;
+const int kMaxPrefetchQueueSize = 20;
 
 } // namespace
 
@@ -32,8 +35,10 @@ const int kPasswordCacheExpirationMSecs = 30 * 60 * 1000;
 
 DataManager::DataManager(const Account &account)
     : account_(account),
+      fetching_dirents_(false),
       filecache_db_(FileCacheDB::instance()),
-      dirents_cache_(DirentsCache::instance())
+      dirents_cache_(DirentsCache::instance()),
+      dirents_db_(DirentsCacheDB::instance())
 {
 }
 
@@ -49,26 +54,175 @@ bool DataManager::getDirents(const QString& repo_id,
                              const QString& path,
                              QList<SeafDirent> *dirents)
 {
-    QList<SeafDirent> *l = dirents_cache_->getCachedDirents(repo_id, path);
-    if (l != NULL) {
-        dirents->append(*l);
-        return true;
-    } else {
-        return false;
-    }
+    return dirents_cache_->getCachedDirents(repo_id, path, dirents);
+}
+
+bool DataManager::getStoredDirents(const QString& repo_id,
+                                   const QString& path,
+                                   QList<SeafDirent> *dirents,
+                                   QString *dir_id)
+{
+    return dirents_cache_->getStaleDirents(repo_id, path, dirents, dir_id) ||
+        dirents_db_->getDirents(repo_id, path, dirents, dir_id);
 }
 
 void DataManager::getDirentsFromServer(const QString& repo_id,
-                                       const QString& path)
+                                       const QString& path,
+                                       const QString& known_dir_id)
 {
-    get_dirents_req_.reset(new GetDirentsRequest(account_, repo_id, path));
+    fetching_dirents_ = true;
+    get_dirents_req_.reset(new GetDirentsRequest(account_, repo_id, path, known_dir_id));
     connect(get_dirents_req_.data(), SIGNAL(success(const QList<SeafDirent>&)),
             this, SLOT(onGetDirentsSuccess(const QList<SeafDirent>&)));
+    connect(get_dirents_req_.data(), SIGNAL(notModified()),
+            this, SLOT(onGetDirentsNotModified()));
     connect(get_dirents_req_.data(), SIGNAL(failed(const ApiError&)),
-            this, SIGNAL(getDirentsFailed(const ApiError&)));
+            this, SLOT(onGetDirentsFailed(const ApiError&)));
     get_dirents_req_->send();
 }
 
+void DataManager::cancelGetDirents()
+{
+    fetching_dirents_ = false;
+    get_dirents_req_.reset();
+}
+
+void DataManager::prefetchDirents(const QString& repo_id,
+                                  const QStringList& paths)
+{
+    if (repo_id != prefetch_repo_id_) {
+        cancelPrefetch();
+        prefetch_repo_id_ = repo_id;
+    }
+
+    QStringList queue;
+    Q_FOREACH(const QString& path, paths)
+    {
+        if (dirents_cache_->hasCachedDirents(repo_id, path) ||
+            (prefetch_req_ && prefetch_req_->path() == path)) {
+            continue;
+        }
+        queue.push_back(path);
+    }
+    Q_FOREACH(const QString& path, prefetch_queue_)
+    {
+        if (!queue.contains(path))
+            queue.push_back(path);
+    }
+    prefetch_queue_ = queue.mid(0, kMaxPrefetchQueueSize);
+
+    prefetchNext();
+}
+
+void DataManager::cancelPrefetch()
+{
+    prefetch_queue_.clear();
+    prefetch_req_.reset();
+}
+
+void DataManager::prefetchNext()
+{
+    // the dirents the user is waiting for go first
+    if (fetching_dirents_ || prefetch_req_) {
+        return;
+    }
+    while (!prefetch_queue_.isEmpty()) {
+        QString path = prefetch_queue_.takeFirst();
+        if (dirents_cache_->hasCachedDirents(prefetch_repo_id_, path)) {
+            continue;
+        }
+        // revalidate the expired dirents instead of downloading them again
+        QList<SeafDirent> stale_dirents;
+        QString known_dir_id;
+        dirents_cache_->getStaleDirents(prefetch_repo_id_, path,
+                                        &stale_dirents, &known_dir_id);
+        prefetch_req_.reset(new GetDirentsRequest(account_, prefetch_repo_id_,
+                                                  path, known_dir_id));
+        prefetch_req_->setPriority(SeafileApiRequest::PRIORITY_BACKGROUND);
+        connect(prefetch_req_.data(), SIGNAL(success(const QList<SeafDirent>&)),
+                this, SLOT(onPrefetchDirentsSuccess(const QList<SeafDirent>&)));
+        connect(prefetch_req_.data(), SIGNAL(notModified()),
+                this, SLOT(onPrefetchDirentsNotModified()));
+        connect(prefetch_req_.data(), SIGNAL(failed(const ApiError&)),
+                this, SLOT(onPrefetchDirentsFailed()));
+        prefetch_req_->send();
+        return;
+    }
+}
+
+void DataManager::onPrefetchDirentsSuccess(const QList<SeafDirent>& dirents)
+{
+    dirents_cache_->saveCachedDirents(prefetch_req_->repoId(),
+                                      prefetch_req_->path(),
+                                      dirents,
+                                      prefetch_req_->dirId());
+    if (indexer_ && indexer_->repoId() == prefetch_req_->repoId()) {
+        indexer_->updateDirents(prefetch_req_->path(), prefetch_req_->dirId(), dirents);
+    }
+    // we are in a signal handler of the request, don't delete it right now
+    prefetch_req_.take()->deleteLater();
+    prefetchNext();
+}
+
+void DataManager::onPrefetchDirentsNotModified()
+{
+    revalidateDirents(prefetch_req_->repoId(),
+                      prefetch_req_->path(),
+                      prefetch_req_->dirId());
+    prefetch_req_.take()->deleteLater();
+    prefetchNext();
+}
+
+/**
+ * The directory has not changed since `dir_id`, make the dirents known for
+ * it valid again in the memory cache
+ */
+void DataManager::revalidateDirents(const QString& repo_id,
+                                    const QString& path,
+                                    const QString& dir_id)
+{
+    if (dirents_cache_->revalidateCachedDirents(repo_id, path, dir_id)) {
+        return;
+    }
+
+    QList<SeafDirent> dirents;
+    QString stored_dir_id;
+    if (dirents_db_->getDirents(repo_id, path, &dirents, &stored_dir_id) &&
+        stored_dir_id == dir_id) {
+        dirents_cache_->saveCachedDirents(repo_id, path, dirents, dir_id);
+    }
+}
+
+void DataManager::onPrefetchDirentsFailed()
+{
+    prefetch_req_.take()->deleteLater();
+    prefetchNext();
+}
+
+void DataManager::startIndexing(const QString& repo_id)
+{
+    if (indexer_ && indexer_->repoId() == repo_id) {
+        return;
+    }
+    indexer_.reset(new RepoIndexer(account_, repo_id));
+    connect(indexer_.data(), SIGNAL(finished()),
+            this, SIGNAL(repoIndexUpdated()));
+    indexer_->start();
+}
+
+bool DataManager::isIndexing() const
+{
+    return indexer_ && indexer_->isIndexing();
+}
+
+QList<RepoIndex::Entry> DataManager::searchRepo(const QString& pattern, int max_results)
+{
+    if (!indexer_) {
+        return QList<RepoIndex::Entry>();
+    }
+    return indexer_->search(pattern, max_results);
+}
+
 void DataManager::createDirectory(const QString &repo_id,
                                   const QString &path)
 {
@@ -170,11 +324,43 @@ void DataManager::moveDirents(const QString &repo_id,
 
 void DataManager::onGetDirentsSuccess(const QList<SeafDirent> &dirents)
 {
+    fetching_dirents_ = false;
     dirents_cache_->saveCachedDirents(get_dirents_req_->repoId(),
                                       get_dirents_req_->path(),
-                                      dirents);
+                                      dirents,
+                                      get_dirents_req_->dirId());
+    dirents_db_->saveDirents(account_.getSignature(),
+                             get_dirents_req_->repoId(),
+                             get_dirents_req_->path(),
+                             get_dirents_req_->dirId(),
+                             dirents);
+    if (indexer_ && indexer_->repoId() == get_dirents_req_->repoId()) {
+        indexer_->updateDirents(get_dirents_req_->path(),
+                                get_dirents_req_->dirId(),
+                                dirents);
+    }
 
     emit getDirentsSuccess(dirents);
+
+    prefetchNext();
+}
+
+void DataManager::onGetDirentsNotModified()
+{
+    fetching_dirents_ = false;
+    // the last known dirents, which are being shown, are still up to date
+    revalidateDirents(get_dirents_req_->repoId(),
+                      get_dirents_req_->path(),
+                      get_dirents_req_->dirId());
+
+    prefetchNext();
+}
+
+void DataManager::onGetDirentsFailed(const ApiError& error)
+{
+    fetching_dirents_ = false;
+    emit getDirentsFailed(error);
+    prefetchNext();
 }
 
 void DataManager::onCreateDirectorySuccess()
@@ -219,6 +405,7 @@ void DataManager::onMoveDirentsSuccess()
 {
     MoveMultipleFilesRequest *req = qobject_cast<MoveMultipleFilesRequest*>(sender());
     dirents_cache_->expireCachedDirents(req->srcRepoId(), req->srcPath());
+    dirents_db_->removeDirents(req->srcRepoId(), req->srcPath());
 
     emit moveDirentsSuccess();
 }
@@ -229,9 +416,12 @@ void DataManager::removeDirentsCache(const QString& repo_id,
 {
     // expire its parent's cache
     dirents_cache_->expireCachedDirents(repo_id, ::getParentPath(path));
+    dirents_db_->removeDirents(repo_id, ::getParentPath(path));
     // if the object is a folder, then expire its self cache
-    if (!is_file)
+    if (!is_file) {
         dirents_cache_->expireCachedDirents(repo_id, path);
+        dirents_db_->removeDirents(repo_id, path);
+    }
 }
 
 
@@ -240,12 +430,83 @@ QString DataManager::getLocalCachedFile(const QString& repo_id,
                                         const QString& file_id)
 {
     QString local_file_path = getLocalCacheFilePath(repo_id, fpath);
-    if (!QFileInfo(local_file_path).exists()) {
+    if (!QFileInfo(local_file_path).exists() ||
+        filecache_db_->getCachedFileId(repo_id, fpath) != file_id) {
+        return cloneCachedFile(repo_id, fpath, file_id);
+    }
+
+    // for the LRU eviction of FileCacheManager
+    filecache_db_->touchCachedFile(repo_id, fpath);
+    return local_file_path;
+}
+
+/**
+ * The same file may have been downloaded for another path, e.g. from
+ * another library, or from a sub-library and its parent library. Clone the
+ * content of that file instead of downloading it again. Only files not
+ * modified since they were downloaded (or uploaded) are cloned.
+ */
+QString DataManager::cloneCachedFile(const QString& repo_id,
+                                     const QString& path,
+                                     const QString& file_id)
+{
+    if (file_id.isEmpty() ||
+        TransferManager::instance()->getDownloadTask(repo_id, path)) {
         return "";
     }
 
-    QString cached_file_id = filecache_db_->getCachedFileId(repo_id, fpath);
-    return cached_file_id == file_id ? local_file_path : "";
+    // The cached file of this path is replaced by the clone. Leave it to
+    // the normal download path if it is being uploaded (and may be mapped),
+    // or has been modified since its last sync and not uploaded yet.
+    QString local_path = getLocalCacheFilePath(repo_id, path);
+    QFileInfo local_info(local_path);
+    if (local_info.exists()) {
+        FileCacheDB::CacheEntry local_entry = filecache_db_->getCacheEntry(repo_id, path);
+        if (AutoUpdateManager::instance()->isUploading(local_path) ||
+            local_entry.mtime == 0 ||
+            local_info.size() != local_entry.size ||
+            local_info.lastModified().toMSecsSinceEpoch() != local_entry.mtime) {
+            return "";
+        }
+    }
+
+    foreach (const FileCacheDB::CacheEntry& entry,
+             filecache_db_->getCacheEntriesByFileId(file_id)) {
+        if (entry.repo_id == repo_id && entry.path == path) {
+            continue;
+        }
+        QString src_path = getLocalCacheFilePath(entry.repo_id, entry.path);
+        QFileInfo src_info(src_path);
+        if (!src_info.isFile() || entry.mtime == 0 ||
+            src_info.size() != entry.size ||
+            src_info.lastModified().toMSecsSinceEpoch() != entry.mtime ||
+            AutoUpdateManager::instance()->isUploading(src_path)) {
+            continue;
+        }
+
+        AutoUpdateManager::instance()->removeWatch(local_path);
+        QFile::remove(local_path);
+        if (!::createDirIfNotExists(::getParentPath(local_path)) ||
+            !::cloneFile(src_path, local_path)) {
+            qWarning("failed to clone cached file %s to %s\n",
+                     toCStr(src_path), toCStr(local_path));
+            return "";
+        }
+
+        QFileInfo file_info(local_path);
+        filecache_db_->saveCachedFileId(repo_id,
+                                        path,
+                                        file_id,
+                                        account_.getSignature(),
+                                        file_info.size(),
+                                        file_info.lastModified().toMSecsSinceEpoch());
+        // used now through another path
+        filecache_db_->touchCachedFile(entry.repo_id, entry.path);
+        AutoUpdateManager::instance()->watchCachedFile(account_, repo_id, path);
+        FileCacheManager::instance()->checkQuotaLater();
+        return local_path;
+    }
+    return "";
 }
 
 FileDownloadTask* DataManager::createDownloadTask(const QString& repo_id,
@@ -276,12 +537,16 @@ void DataManager::onFileDownloadFinished(bool success)
     if (task == NULL)
         return;
     if (success) {
+        QFileInfo file_info(task->localFilePath());
         filecache_db_->saveCachedFileId(task->repoId(),
                                         task->path(),
                                         task->fileId(),
-                                        account_.getSignature());
+                                        account_.getSignature(),
+                                        file_info.size(),
+                                        file_info.lastModified().toMSecsSinceEpoch());
         AutoUpdateManager::instance()->watchCachedFile(
             account_, task->repoId(), task->path());
+        FileCacheManager::instance()->checkQuotaLater();
     }
 }
 
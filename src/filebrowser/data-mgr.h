@@ -4,10 +4,12 @@
 #include <QObject>
 #include <QHash>
 #include <QScopedPointer>
+#include <QStringList>
 
 #include "api/api-error.h"
 #include "account.h"
 #include "seaf-dirent.h"
+#include "repo-index.h"
 #include "utils/singleton.h"
 
 
@@ -18,6 +20,7 @@ class GetDirentsRequest;
 class GetRepoRequest;
 class CreateSubrepoRequest;
 class DirentsCache;
+class DirentsCacheDB;
 class FileCacheDB;
 class FileUploadTask;
 class FileDownloadTask;
@@ -38,8 +41,43 @@ public:
                     const QString& path,
                     QList<SeafDirent> *dirents);
 
+    /**
+     * Get the last known dirents, which may be out of date: the expired
+     * dirents kept in memory, or else the dirents saved on disk.
+     * Pass the returned `dir_id` to getDirentsFromServer to revalidate them.
+     */
+    bool getStoredDirents(const QString& repo_id,
+                          const QString& path,
+                          QList<SeafDirent> *dirents,
+                          QString *dir_id);
+
+    /**
+     * Fetch the dirents from the server. If `known_dir_id` is given and the
+     * directory has not changed since then, getDirentsSuccess is not emitted.
+     */
     void getDirentsFromServer(const QString& repo_id,
-                              const QString& path);
+                              const QString& path,
+                              const QString& known_dir_id = QString());
+    // Drop the reply of getDirentsFromServer, if it is still waited for
+    void cancelGetDirents();
+
+    /**
+     * Fetch the dirents of the given folders into DirentsCache in the
+     * background, so entering them later needs no round trip. The folders
+     * are fetched one at a time, and only while getDirentsFromServer is not
+     * waiting for its reply. The folders of the latest call go first.
+     */
+    void prefetchDirents(const QString& repo_id, const QStringList& paths);
+    void cancelPrefetch();
+
+    /**
+     * Index the names of all the files and folders of the library in the
+     * background, for searchRepo. repoIndexUpdated is emitted once the whole
+     * library is indexed.
+     */
+    void startIndexing(const QString& repo_id);
+    bool isIndexing() const;
+    QList<RepoIndex::Entry> searchRepo(const QString& pattern, int max_results);
 
     void createDirectory(const QString &repo_id,
                          const QString &path);
@@ -127,8 +165,15 @@ signals:
     void createSubrepoSuccess(const ServerRepo &repo);
     void createSubrepoFailed(const ApiError& error);
 
+    void repoIndexUpdated();
+
 private slots:
     void onGetDirentsSuccess(const QList<SeafDirent>& dirents);
+    void onGetDirentsFailed(const ApiError& error);
+    void onGetDirentsNotModified();
+    void onPrefetchDirentsSuccess(const QList<SeafDirent>& dirents);
+    void onPrefetchDirentsNotModified();
+    void onPrefetchDirentsFailed();
     void onFileUploadFinished(bool success);
     void onFileDownloadFinished(bool success);
 
@@ -145,9 +190,23 @@ private:
     void removeDirentsCache(const QString& repo_id,
                             const QString& path,
                             bool is_file);
+    void prefetchNext();
+    void revalidateDirents(const QString& repo_id,
+                           const QString& path,
+                           const QString& dir_id);
+    QString cloneCachedFile(const QString& repo_id,
+                            const QString& path,
+                            const QString& file_id);
     const Account account_;
 
     QScopedPointer<GetDirentsRequest> get_dirents_req_;
+    bool fetching_dirents_;
+
+    QScopedPointer<GetDirentsRequest> prefetch_req_;
+    QString prefetch_repo_id_;
+    QStringList prefetch_queue_;
+
+    QScopedPointer<RepoIndexer> indexer_;
 
     QScopedPointer<CreateSubrepoRequest> create_subrepo_req_;
     QString create_subrepo_parent_repo_id_;
@@ -160,6 +219,8 @@ private:
 
     DirentsCache *dirents_cache_;
 
+    DirentsCacheDB *dirents_db_;
+
     static QHash<QString, qint64> passwords_cache_;
 };
 
@@ -45,6 +45,10 @@ enum {
 const char *kLoadingFaieldLabelName = "loadingFailedText";
 const int kToolBarIconSize = 20;
 const int kStatusBarIconSize = 24;
+// number of folders whose dirents are fetched before they are entered
+const int kPrefetchFoldersCount = 5;
+const int kMaxSearchResults = 50;
+const int kSearchEditWidth = 200;
 //const int kStatusCodePasswordNeeded = 400;
 
 void openFile(const QString& path)
@@ -80,7 +84,8 @@ FileBrowserDialog::FileBrowserDialog(const Account &account, const ServerRepo& r
     : QDialog(parent),
       account_(account),
       repo_(repo),
-      current_path_(path)
+      current_path_(path),
+      revalidating_(false)
 {
     current_lpath_ = current_path_.split('/');
 
@@ -156,6 +161,8 @@ FileBrowserDialog::FileBrowserDialog(const Account &account, const ServerRepo& r
             this, SLOT(onCancelDownload(const SeafDirent&)));
     connect(table_view_, SIGNAL(syncSubdirectory(const QString&)),
             this, SLOT(onGetSyncSubdirectory(const QString &)));
+    connect(table_view_, SIGNAL(direntHovered(const SeafDirent&)),
+            this, SLOT(onDirentHovered(const SeafDirent&)));
 
     //dirents <--> data_mgr_
     connect(data_mgr_, SIGNAL(getDirentsSuccess(const QList<SeafDirent>&)),
@@ -208,6 +215,9 @@ FileBrowserDialog::FileBrowserDialog(const Account &account, const ServerRepo& r
     connect(AutoUpdateManager::instance(), SIGNAL(fileUpdated(const QString&, const QString&)),
             this, SLOT(onFileAutoUpdated(const QString&, const QString&)));
 
+    connect(data_mgr_, SIGNAL(repoIndexUpdated()),
+            this, SLOT(onRepoIndexUpdated()));
+
     QTimer::singleShot(0, this, SLOT(fetchDirents()));
 }
 
@@ -293,6 +303,26 @@ void FileBrowserDialog::createToolBar()
     connect(path_navigator_root_, SIGNAL(clicked()),
             this, SLOT(goHome()));
     toolbar_->addWidget(path_navigator_root_);
+
+    QWidget *spacer = new QWidget;
+    spacer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+    search_spacer_action_ = toolbar_->addWidget(spacer);
+
+    // search the files of the whole library by name
+    search_edit_ = new QLineEdit;
+    search_edit_->setObjectName("searchEdit");
+    search_edit_->setPlaceholderText(tr("Search files"));
+    search_edit_->setFixedWidth(kSearchEditWidth);
+    search_edit_->installEventFilter(this);
+    search_model_ = new QStringListModel(this);
+    search_completer_ = new QCompleter(search_model_, this);
+    search_completer_->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    search_edit_->setCompleter(search_completer_);
+    connect(search_edit_, SIGNAL(textEdited(const QString&)),
+            this, SLOT(onSearchTextEdited(const QString&)));
+    connect(search_completer_, SIGNAL(activated(const QString&)),
+            this, SLOT(onSearchResultActivated(const QString&)));
+    toolbar_->addWidget(search_edit_);
 }
 
 void FileBrowserDialog::createStatusBar()
@@ -393,12 +423,29 @@ void FileBrowserDialog::fetchDirents(bool force_refresh)
         }
     }
 
+    // the folder being fetched, or revalidated while its last known dirents
+    // are shown, and the folders being prefetched are not of interest
+    // anymore: their replies must not be taken for the current folder
+    data_mgr_->cancelGetDirents();
+    data_mgr_->cancelPrefetch();
+
+    revalidating_ = false;
     if (!force_refresh) {
         QList<SeafDirent> dirents;
         if (data_mgr_->getDirents(repo_.id, current_path_, &dirents)) {
             updateTable(dirents);
             return;
         }
+
+        QString dir_id;
+        if (data_mgr_->getStoredDirents(repo_.id, current_path_, &dirents, &dir_id)) {
+            // sent before updateTable starts prefetching the sub folders,
+            // so the prefetching waits for it
+            revalidating_ = true;
+            data_mgr_->getDirentsFromServer(repo_.id, current_path_, dir_id);
+            updateTable(dirents);
+            return;
+        }
     }
 
     showLoading();
@@ -412,6 +459,10 @@ void FileBrowserDialog::onGetDirentsSuccess(const QList<SeafDirent>& dirents)
 
 void FileBrowserDialog::onGetDirentsFailed(const ApiError& error)
 {
+    // keep showing the last known dirents
+    if (revalidating_) {
+        return;
+    }
     stack_->setCurrentIndex(INDEX_LOADING_FAILED_VIEW);
 }
 
@@ -540,12 +591,12 @@ void FileBrowserDialog::enterPath(const QString& path)
         separator->setBaseSize(4, 7);
         separator->setPixmap(QIcon(":/images/filebrowser/path-separator.png").pixmap(QSize(4, 7)));
         path_navigator_separators_.push_back(separator);
-        toolbar_->addWidget(separator);
+        toolbar_->insertWidget(search_spacer_action_, separator);
         QPushButton* button = new QPushButton(current_lpath_[i]);
         button->setFlat(true);
         button->setCursor(Qt::PointingHandCursor);
         path_navigator_->addButton(button, i);
-        toolbar_->addWidget(button);
+        toolbar_->insertWidget(search_spacer_action_, button);
     }
 }
 
@@ -834,6 +885,27 @@ void FileBrowserDialog::updateTable(const QList<SeafDirent>& dirents)
         upload_button_->setEnabled(true);
     }
     gohome_action_->setEnabled(true);
+
+    prefetchFolders();
+}
+
+void FileBrowserDialog::prefetchFolders()
+{
+    QStringList paths;
+    Q_FOREACH(const SeafDirent *dirent, table_view_->firstFolders(kPrefetchFoldersCount))
+    {
+        paths.push_back(::pathJoin(current_path_, dirent->name));
+    }
+    data_mgr_->prefetchDirents(repo_.id, paths);
+}
+
+void FileBrowserDialog::onDirentHovered(const SeafDirent& dirent)
+{
+    if (stack_->currentIndex() != INDEX_TABLE_VIEW) {
+        return;
+    }
+    data_mgr_->prefetchDirents(repo_.id,
+                               QStringList(::pathJoin(current_path_, dirent.name)));
 }
 
 void FileBrowserDialog::chooseFileToUpload()
@@ -999,6 +1071,38 @@ void FileBrowserDialog::onFileAutoUpdated(const QString& repo_id, const QString&
     }
 }
 
+void FileBrowserDialog::onSearchTextEdited(const QString& text)
+{
+    data_mgr_->startIndexing(repo_.id);
+
+    QStringList paths;
+    foreach (const RepoIndex::Entry& entry,
+             data_mgr_->searchRepo(text.trimmed(), kMaxSearchResults)) {
+        paths.push_back(entry.is_dir ? entry.path + "/" : entry.path);
+    }
+    search_model_->setStringList(paths);
+    if (!paths.isEmpty()) {
+        search_completer_->complete();
+    }
+}
+
+void FileBrowserDialog::onSearchResultActivated(const QString& path)
+{
+    // show the folder, or the folder containing the file
+    QString dir_path = path.endsWith("/") ? path : ::getParentPath(path);
+    backward_history_.push(current_path_);
+    forward_history_.clear();
+    enterPath(dir_path);
+}
+
+void FileBrowserDialog::onRepoIndexUpdated()
+{
+    // the results may have been searched while the library was indexed
+    if (search_edit_->hasFocus() && !search_edit_->text().trimmed().isEmpty()) {
+        onSearchTextEdited(search_edit_->text());
+    }
+}
+
 void FileBrowserDialog::onCancelDownload(const SeafDirent& dirent)
 {
     TransferManager::instance()->cancelDownload(repo_.id,
@@ -1018,6 +1122,9 @@ bool FileBrowserDialog::eventFilter(QObject *obj, QEvent *event)
             move(ev->globalPos() - old_pos_);
             return true;
         }
+    } else if (obj == search_edit_ && event->type() == QEvent::FocusIn) {
+        // the user is likely to search, index the library meanwhile
+        data_mgr_->startIndexing(repo_.id);
     }
     return QDialog::eventFilter(obj, event);
 }
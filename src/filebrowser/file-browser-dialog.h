@@ -17,6 +17,8 @@ class QButtonGroup;
 class QMenu;
 class QAction;
 class QSizeGrip;
+class QCompleter;
+class QStringListModel;
 
 class ApiError;
 class FileTableView;
@@ -58,6 +60,7 @@ signals:
 private slots:
     void onGetDirentsSuccess(const QList<SeafDirent>& dirents);
     void onGetDirentsFailed(const ApiError& error);
+    void onDirentHovered(const SeafDirent& dirent);
     void onMkdirButtonClicked();
     void fetchDirents();
     void onDirentClicked(const SeafDirent& dirent);
@@ -109,6 +112,10 @@ private slots:
 
     void onFileAutoUpdated(const QString& repo_id, const QString& path);
 
+    void onSearchTextEdited(const QString& text);
+    void onSearchResultActivated(const QString& path);
+    void onRepoIndexUpdated();
+
 private:
     Q_DISABLE_COPY(FileBrowserDialog)
 
@@ -126,6 +133,7 @@ private:
     void createLoadingFailedView();
     void showLoading();
     void updateTable(const QList<SeafDirent>& dirents);
+    void prefetchFolders();
     void createDirectory(const QString &name);
     void downloadFile(const QString& path);
     void uploadFile(const QString& path, const QString& name,
@@ -171,6 +179,11 @@ private:
     QList<QLabel*> path_navigator_separators_;
     QAction *gohome_action_;
     QAction *refresh_action_;
+    // the path navigator buttons are inserted before it
+    QAction *search_spacer_action_;
+    QLineEdit *search_edit_;
+    QCompleter *search_completer_;
+    QStringListModel *search_model_;
 
     // status toolbar
     QToolBar *status_bar_;
@@ -190,6 +203,8 @@ private:
     FileTableModel *table_model_;
 
     DataManager *data_mgr_;
+    // the last known dirents are shown while fetching the current ones
+    bool revalidating_;
 };
 
 
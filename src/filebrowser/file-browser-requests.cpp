@@ -18,6 +18,7 @@ const char kGetFileUpdateUrl[] = "api2/repos/%1/update-link/";
 const char kGetStarredFilesUrl[] = "api2/starredfiles/";
 const char kFileOperationCopy[] = "api2/repos/%1/fileops/copy/";
 const char kFileOperationMove[] = "api2/repos/%1/fileops/move/";
+const char kGetThumbnailUrl[] = "api2/repos/%1/thumbnail/";
 //const char kGetFileFromRevisionUrl[] = "api2/repos/%1/file/revision/";
 //const char kGetFileDetailUrl[] = "api2/repos/%1/file/detail/";
 //const char kGetFileHistoryUrl[] = "api2/repos/%1/file/history/";
@@ -27,12 +28,22 @@ const char kFileOperationMove[] = "api2/repos/%1/fileops/move/";
 
 GetDirentsRequest::GetDirentsRequest(const Account& account,
                                      const QString& repo_id,
-                                     const QString& path)
+                                     const QString& path,
+                                     const QString& known_dir_id)
     : SeafileApiRequest (account.getAbsoluteUrl(QString(kGetDirentsUrl).arg(repo_id)),
                          SeafileApiRequest::METHOD_GET, account.token),
-      repo_id_(repo_id), path_(path)
+      repo_id_(repo_id), path_(path), known_dir_id_(known_dir_id)
 {
     setUrlParam("p", path);
+    // the server replies "uptodate" instead of the dirents if the id of
+    // the directory is still the same
+    if (!known_dir_id.isEmpty()) {
+        setUrlParam("oid", known_dir_id);
+    }
+    // a folder may have tens of thousands of dirents
+    setStreamJSON(true);
+    // the user is waiting for it, unless told otherwise
+    setPriority(PRIORITY_INTERACTIVE);
 }
 
 void GetDirentsRequest::requestSuccess(QNetworkReply& reply)
@@ -44,6 +55,12 @@ void GetDirentsRequest::requestSuccess(QNetworkReply& reply)
         return;
     }
 
+    if (!known_dir_id_.isEmpty() && dir_id == known_dir_id_) {
+        dir_id_ = dir_id;
+        emit notModified();
+        return;
+    }
+
     json_t *root = parseJSON(reply, &error);
     if (!root) {
         qDebug("GetDirentsRequest: failed to parse json:%s\n", error.text);
@@ -55,6 +72,7 @@ void GetDirentsRequest::requestSuccess(QNetworkReply& reply)
 
     QList<SeafDirent> dirents;
     dirents = SeafDirent::listFromJSON(json.data(), &error);
+    dir_id_ = dir_id;
     emit success(dirents);
 }
 
@@ -66,6 +84,7 @@ GetFileDownloadLinkRequest::GetFileDownloadLinkRequest(const Account &account,
           SeafileApiRequest::METHOD_GET, account.token)
 {
     setUrlParam("p", path);
+    setPriority(PRIORITY_INTERACTIVE);
 }
 
 void GetFileDownloadLinkRequest::requestSuccess(QNetworkReply& reply)
@@ -303,3 +322,26 @@ void UnstarFileRequest::requestSuccess(QNetworkReply& reply)
     emit success();
 }
 
+GetThumbnailRequest::GetThumbnailRequest(const Account &account,
+                                         const QString &repo_id,
+                                         const QString &path,
+                                         int size)
+    : SeafileApiRequest(
+          account.getAbsoluteUrl(QString(kGetThumbnailUrl).arg(repo_id)),
+          SeafileApiRequest::METHOD_GET, account.token),
+      repo_id_(repo_id), path_(path)
+{
+    setUrlParam("p", path);
+    setUrlParam("size", QString::number(size));
+    setPriority(PRIORITY_BACKGROUND);
+}
+
+void GetThumbnailRequest::requestSuccess(QNetworkReply& reply)
+{
+    QByteArray image_data = reply.readAll();
+    if (image_data.isEmpty()) {
+        emit failed(ApiError::fromHttpError(500));
+        return;
+    }
+    emit success(image_data);
+}
@@ -14,15 +14,22 @@ class QDir;
 class GetDirentsRequest : public SeafileApiRequest {
     Q_OBJECT
 public:
+    // If `known_dir_id` is given, the server only returns the dirents when
+    // the directory has changed since then, otherwise `notModified` is
+    // emitted
     GetDirentsRequest(const Account& account,
                       const QString& repo_id,
-                      const QString& path);
+                      const QString& path,
+                      const QString& known_dir_id = QString());
 
     const QString& repoId() const { return repo_id_; }
     const QString& path() const { return path_; }
+    // the id of the directory, valid once the request succeeded
+    const QString& dirId() const { return dir_id_; }
 
 signals:
     void success(const QList<SeafDirent> &dirents);
+    void notModified();
 
 protected slots:
     void requestSuccess(QNetworkReply& reply);
@@ -32,6 +39,8 @@ private:
 
     const QString repo_id_;
     const QString path_;
+    const QString known_dir_id_;
+    QString dir_id_;
 };
 
 class GetFileDownloadLinkRequest : public SeafileApiRequest {
@@ -265,4 +274,30 @@ private:
     Q_DISABLE_COPY(UnstarFileRequest)
 };
 
+/**
+ * Get a thumbnail of an image file, generated by the server. The image is
+ * not decoded here, so that it can be done off the main thread.
+ */
+class GetThumbnailRequest : public SeafileApiRequest {
+    Q_OBJECT
+public:
+    GetThumbnailRequest(const Account &account, const QString &repo_id,
+                        const QString &path, int size);
+
+    const QString& repoId() const { return repo_id_; }
+    const QString& path() const { return path_; }
+
+signals:
+    void success(const QByteArray& image_data);
+
+protected slots:
+    void requestSuccess(QNetworkReply& reply);
+
+private:
+    Q_DISABLE_COPY(GetThumbnailRequest)
+
+    const QString repo_id_;
+    const QString path_;
+};
+
 #endif  // SEAFILE_CLIENT_FILE_BROWSER_REQUESTS_H
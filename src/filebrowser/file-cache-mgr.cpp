@@ -0,0 +1,146 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QTimer>
+
+#include "utils/utils.h"
+#include "seafile-applet.h"
+#include "settings-mgr.h"
+#include "auto-update-mgr.h"
+#include "data-mgr.h"
+
+#include "file-cache-mgr.h"
+
+namespace {
+
+const int kCheckQuotaIntervalMSecs = 10 * 60 * 1000;
+const int kCheckQuotaDelayMSecs = 5 * 1000;
+
+// Remove files until the total size drops below this ratio of the quota,
+// so that the eviction does not run again after every download
+const double kEvictTargetRatio = 0.9;
+
+// Files used recently may still be open in other applications
+const qint64 kMinIdleMSecs = 60 * 60 * 1000;
+
+bool lessRecentlyUsed(const FileCacheDB::CacheEntry& a,
+                      const FileCacheDB::CacheEntry& b)
+{
+    return a.atime < b.atime;
+}
+
+} // namespace
+
+SINGLETON_IMPL(FileCacheManager)
+
+FileCacheManager::FileCacheManager()
+    : checking_(false)
+{
+    check_timer_ = new QTimer(this);
+    connect(check_timer_, SIGNAL(timeout()), this, SLOT(checkQuota()));
+
+    delay_timer_ = new QTimer(this);
+    delay_timer_->setSingleShot(true);
+    connect(delay_timer_, SIGNAL(timeout()), this, SLOT(checkQuota()));
+
+    connect(FileCacheDB::instance(),
+            SIGNAL(allCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)),
+            this, SLOT(onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>&)));
+}
+
+void FileCacheManager::start()
+{
+    check_timer_->start(kCheckQuotaIntervalMSecs);
+    checkQuotaLater();
+}
+
+void FileCacheManager::checkQuotaLater()
+{
+    if (!delay_timer_->isActive()) {
+        delay_timer_->start(kCheckQuotaDelayMSecs);
+    }
+}
+
+void FileCacheManager::checkQuota()
+{
+    if (checking_) {
+        return;
+    }
+    checking_ = true;
+    FileCacheDB::instance()->loadAllCachedFiles();
+}
+
+bool FileCacheManager::isEvictable(const FileCacheDB::CacheEntry& entry,
+                                   const QString& local_path,
+                                   const QFileInfo& file_info,
+                                   qint64 now) const
+{
+    if (AutoUpdateManager::instance()->isUploading(local_path)) {
+        return false;
+    }
+    if (now < entry.atime + kMinIdleMSecs) {
+        return false;
+    }
+    // modified locally, but not uploaded yet
+    return file_info.size() == entry.size &&
+        file_info.lastModified().toMSecsSinceEpoch() == entry.mtime;
+}
+
+void FileCacheManager::onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>& all_files)
+{
+    if (!checking_) {
+        return;
+    }
+    checking_ = false;
+
+    FileCacheDB *db = FileCacheDB::instance();
+    qint64 quota = seafApplet->settingsManager()->fileCacheQuotaMB() * 1024LL * 1024LL;
+    qint64 total = 0;
+    QList<FileCacheDB::CacheEntry> entries;
+    foreach (const FileCacheDB::CacheEntry& entry, all_files) {
+        QFileInfo file_info(DataManager::getLocalCacheFilePath(entry.repo_id, entry.path));
+        if (!file_info.exists()) {
+            db->removeCachedFile(entry.repo_id, entry.path);
+            continue;
+        }
+        if (entry.mtime == 0) {
+            // recorded by older versions, take the current state as the
+            // state in sync with the server
+            db->updateCachedFileState(entry.repo_id, entry.path, file_info.size(),
+                                      file_info.lastModified().toMSecsSinceEpoch());
+        }
+        total += file_info.size();
+        entries.append(entry);
+    }
+    if (total <= quota) {
+        return;
+    }
+
+    qint64 target = quota * kEvictTargetRatio;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qSort(entries.begin(), entries.end(), lessRecentlyUsed);
+    foreach (const FileCacheDB::CacheEntry& entry, entries) {
+        if (total <= target) {
+            break;
+        }
+        QString local_path = DataManager::getLocalCacheFilePath(entry.repo_id, entry.path);
+        QFileInfo file_info(local_path);
+        if (!isEvictable(entry, local_path, file_info, now)) {
+            continue;
+        }
+        AutoUpdateManager::instance()->removeWatch(local_path);
+        if (!QFile::remove(local_path)) {
+            qWarning("failed to remove cached file %s\n", toCStr(local_path));
+            continue;
+        }
+        qDebug("removed cached file %s (%lld bytes)\n",
+               toCStr(local_path), file_info.size());
+        total -= file_info.size();
+        db->removeCachedFile(entry.repo_id, entry.path);
+    }
+
+    if (total > quota) {
+        qWarning("file cache uses %lld bytes, over the quota of %lld bytes\n",
+                 total, quota);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef SEAFILE_CLIENT_FILE_BROWSER_FILE_CACHE_MANAGER_H
+#define SEAFILE_CLIENT_FILE_BROWSER_FILE_CACHE_MANAGER_H
+
+#include <QObject>
+#include <QList>
+
+#include "utils/singleton.h"
+#include "data-cache.h"
+
+class QTimer;
+class QFileInfo;
+
+/**
+ * Keep the total size of the files downloaded by the file browser (under
+ * "<seafileDir>/file-cache") within the quota set by
+ * `SettingsManager::fileCacheQuotaMB()`.
+ *
+ * When the quota is exceeded, the least recently used files are removed
+ * until the total drops below 90% of the quota. The access times and sizes
+ * are recorded in `FileCacheDB`. A cached file is never removed if:
+ *
+ * - it is being uploaded by `AutoUpdateManager`,
+ * - it has been modified since it was last in sync with the server, or
+ * - it has been used in the last hour, since it may still be open.
+ */
+class FileCacheManager : public QObject {
+    SINGLETON_DEFINE(FileCacheManager)
+    Q_OBJECT
+
+public:
+    void start();
+
+    // Check the quota a moment later, so the downloads finished close to
+    // each other only trigger one check
+    void checkQuotaLater();
+
+public slots:
+    void checkQuota();
+
+private slots:
+    void onCachedFilesLoaded(const QList<FileCacheDB::CacheEntry>& all_files);
+
+private:
+    FileCacheManager();
+
+    bool isEvictable(const FileCacheDB::CacheEntry& entry,
+                     const QString& local_path,
+                     const QFileInfo& file_info,
+                     qint64 now) const;
+
+    QTimer *check_timer_;
+    QTimer *delay_timer_;
+    // waiting for the cached files loaded by FileCacheDB
+    bool checking_;
+};
+
+#endif // SEAFILE_CLIENT_FILE_BROWSER_FILE_CACHE_MANAGER_H
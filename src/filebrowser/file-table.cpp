@@ -17,6 +17,7 @@
 #include "data-mgr.h"
 #include "transfer-mgr.h"
 #include "tasks.h"
+#include "thumbnail-service.h"
 
 #include "file-table.h"
 
@@ -216,6 +217,9 @@ FileTableView::FileTableView(const ServerRepo& repo, QWidget *parent)
 
     connect(this, SIGNAL(doubleClicked(const QModelIndex&)),
             this, SLOT(onItemDoubleClicked(const QModelIndex&)));
+    // emitted when the mouse moves over an item, since mouse tracking is on
+    connect(this, SIGNAL(entered(const QModelIndex&)),
+            this, SLOT(onItemEntered(const QModelIndex&)));
 
     setupContextMenu();
 }
@@ -470,6 +474,29 @@ void FileTableView::onAboutToReset()
     item_.reset(NULL);
 }
 
+void FileTableView::onItemEntered(const QModelIndex& index)
+{
+    const SeafDirent *dirent =
+      source_model_->direntAt(proxy_model_->mapToSource(index).row());
+
+    if (dirent == NULL || !dirent->isDir())
+        return;
+
+    emit direntHovered(*dirent);
+}
+
+QList<const SeafDirent*> FileTableView::firstFolders(int max) const
+{
+    QList<const SeafDirent*> folders;
+    for (int row = 0; row < proxy_model_->rowCount() && folders.size() < max; row++) {
+        const SeafDirent *dirent = source_model_->direntAt(
+            proxy_model_->mapToSource(proxy_model_->index(row, 0)).row());
+        if (dirent != NULL && dirent->isDir())
+            folders.push_back(dirent);
+    }
+    return folders;
+}
+
 void FileTableView::onItemDoubleClicked(const QModelIndex& index)
 {
     const SeafDirent *dirent =
@@ -673,6 +700,9 @@ FileTableModel::FileTableModel(QObject *parent)
     connect(task_progress_timer_, SIGNAL(timeout()),
             this, SLOT(updateDownloadInfo()));
     task_progress_timer_->start(kRefreshProgressInterval);
+
+    connect(ThumbnailService::instance(), SIGNAL(thumbnailReady(const QString&)),
+            this, SLOT(onThumbnailReady(const QString&)));
 }
 
 void FileTableModel::setDirents(const QList<SeafDirent>& dirents)
@@ -704,6 +734,10 @@ QVariant FileTableModel::data(const QModelIndex & index, int role) const
     const SeafDirent& dirent = dirents_[row];
 
     if (role == Qt::DecorationRole && column == FILE_COLUMN_NAME) {
+        QPixmap thumbnail = getThumbnail(dirent);
+        if (!thumbnail.isNull()) {
+            return thumbnail;
+        }
         return (dirent.isDir() ?
             QIcon(":/images/files_v2/file_folder.png") :
             QIcon(getIconByFileNameV2(dirent.name))).
@@ -751,6 +785,32 @@ QVariant FileTableModel::data(const QModelIndex & index, int role) const
     }
 }
 
+/**
+ * The thumbnails are fetched only when the rows are painted, i.e. in view
+ */
+QPixmap FileTableModel::getThumbnail(const SeafDirent& dirent) const
+{
+    FileBrowserDialog *dialog = (FileBrowserDialog *)(QObject::parent());
+    // the server can't read the files of encrypted libraries
+    if (!dirent.isFile() || dialog->repo_.encrypted ||
+        !mimeTypeFromFileName(dirent.name).startsWith("image/")) {
+        return QPixmap();
+    }
+    return ThumbnailService::instance()->getThumbnail(
+        dialog->account_, dialog->repo_.id,
+        ::pathJoin(dialog->current_path_, dirent.name),
+        dirent.id, kColumnIconSize);
+}
+
+void FileTableModel::onThumbnailReady(const QString& file_id)
+{
+    for (int pos = 0; pos != dirents_.size(); pos++) {
+        if (dirents_.at(pos).id == file_id) {
+            emit dataChanged(index(pos, FILE_COLUMN_NAME), index(pos, FILE_COLUMN_NAME));
+        }
+    }
+}
+
 QString FileTableModel::getTransferProgress(const SeafDirent& dirent) const
 {
     return progresses_[dirent.name];
@@ -794,7 +854,7 @@ const SeafDirent* FileTableModel::direntAt(int row) const
 void FileTableModel::replaceItem(const QString &name, const SeafDirent &dirent)
 {
     for (int pos = 0; pos != dirents_.size() ; pos++)
-        if (dirents_[pos].name == name) {
+        if (dirents_.at(pos).name == name) {
             dirents_[pos] = dirent;
             emit dataChanged(index(pos, 0), index(pos , FILE_MAX_COLUMN - 1));
             break;
@@ -813,7 +873,7 @@ void FileTableModel::insertItem(int pos, const SeafDirent &dirent)
 void FileTableModel::removeItemNamed(const QString &name)
 {
     for (int pos = 0; pos != dirents_.size() ; pos++)
-        if (dirents_[pos].name == name) {
+        if (dirents_.at(pos).name == name) {
             beginRemoveRows(QModelIndex(), pos, pos);
             dirents_.removeAt(pos);
             endRemoveRows();
@@ -824,7 +884,7 @@ void FileTableModel::removeItemNamed(const QString &name)
 void FileTableModel::renameItemNamed(const QString &name, const QString &new_name)
 {
     for (int pos = 0; pos != dirents_.size() ; pos++)
-        if (dirents_[pos].name == name) {
+        if (dirents_.at(pos).name == name) {
             dirents_[pos].name = new_name;
             emit dataChanged(index(pos, 0), index(pos , FILE_MAX_COLUMN - 1));
             break;
@@ -30,6 +30,9 @@ public:
     FileTableView(const ServerRepo& repo, QWidget *parent);
     void setModel(QAbstractItemModel *model);
 
+    // Return up to `max` folders in the order they are shown
+    QList<const SeafDirent*> firstFolders(int max) const;
+
 signals:
     void direntClicked(const SeafDirent& dirent);
     void direntSaveAs(const SeafDirent& dirent);
@@ -43,10 +46,12 @@ signals:
 
     void cancelDownload(const SeafDirent& dirent);
     void syncSubdirectory(const QString& folder_name);
+    void direntHovered(const SeafDirent& dirent);
 
 private slots:
     void onAboutToReset();
     void onItemDoubleClicked(const QModelIndex& index);
+    void onItemEntered(const QModelIndex& index);
     void onOpen();
     void onSaveAs();
     void onRename();
@@ -115,6 +120,8 @@ public:
 
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
+    // The list is shared with the caller (and DirentsCache), not copied,
+    // until the model changes one of its items
     void setDirents(const QList<SeafDirent>& dirents);
     const QList<SeafDirent>& dirents() const { return dirents_; }
 
@@ -132,11 +139,13 @@ public:
 
 private slots:
     void updateDownloadInfo();
+    void onThumbnailReady(const QString& file_id);
 
 private:
     Q_DISABLE_COPY(FileTableModel)
 
     QString getTransferProgress(const SeafDirent& dirent) const;
+    QPixmap getThumbnail(const SeafDirent& dirent) const;
 
     QList<SeafDirent> dirents_;
 
@@ -0,0 +1,332 @@
+#include <QSet>
+#include <QtAlgorithms>
+
+#include "utils/utils.h"
+#include "utils/file-utils.h"
+#include "file-browser-requests.h"
+#include "data-cache.h"
+
+#include "repo-index.h"
+
+namespace {
+
+const QChar kNameSeparator(0);
+
+// "/a/b/" and "/a/b" are the same folder
+QString normalizeDirPath(const QString& path)
+{
+    if (path.isEmpty()) {
+        return "/";
+    }
+    if (path.size() > 1 && path.endsWith('/')) {
+        return path.left(path.size() - 1);
+    }
+    return path;
+}
+
+// The names of the sub folders of a listing
+QSet<QString> subdirNames(const QList<SeafDirent>& dirents)
+{
+    QSet<QString> names;
+    foreach (const SeafDirent& dirent, dirents) {
+        if (dirent.isDir()) {
+            names.insert(dirent.name);
+        }
+    }
+    return names;
+}
+
+} // namespace
+
+void RepoIndex::setDirents(const QString& dir_path,
+                           const QString& dir_id,
+                           const QList<SeafDirent>& dirents)
+{
+    QString path = normalizeDirPath(dir_path);
+    Listing& listing = dirs_[path];
+
+    if (listing.indexed) {
+        // swap the names of this folder, and only walk the sub folders
+        // which come and go with it
+        QSet<QString> old_subdirs = subdirNames(listing.dirents);
+        QSet<QString> new_subdirs = subdirNames(dirents);
+        foreach (const SeafDirent& dirent, listing.dirents) {
+            removeName(path, dirent);
+            if (dirent.isDir() && !new_subdirs.contains(dirent.name)) {
+                removeFromIndex(::pathJoin(path, dirent.name));
+            }
+        }
+        listing.dirents = dirents;
+        foreach (const SeafDirent& dirent, dirents) {
+            addName(path, dirent);
+            if (dirent.isDir() && !old_subdirs.contains(dirent.name)) {
+                addToIndex(::pathJoin(path, dirent.name));
+            }
+        }
+    } else {
+        listing.dirents = dirents;
+    }
+    listing.dir_id = dir_id;
+
+    listing.names.clear();
+    listing.offsets.clear();
+    foreach (const SeafDirent& dirent, dirents) {
+        listing.offsets.push_back(listing.names.size());
+        listing.names.append(dirent.name.toCaseFolded());
+        listing.names.append(kNameSeparator);
+    }
+
+    if (!listing.indexed && isReachable(path)) {
+        addToIndex(path);
+    }
+}
+
+bool RepoIndex::hasDirents(const QString& dir_path) const
+{
+    return dirs_.contains(normalizeDirPath(dir_path));
+}
+
+QString RepoIndex::dirId(const QString& dir_path) const
+{
+    return dirs_.value(normalizeDirPath(dir_path)).dir_id;
+}
+
+QList<SeafDirent> RepoIndex::dirents(const QString& dir_path) const
+{
+    return dirs_.value(normalizeDirPath(dir_path)).dirents;
+}
+
+bool RepoIndex::isReachable(const QString& dir_path) const
+{
+    if (dir_path == "/") {
+        return true;
+    }
+    QMap<QString, Listing>::const_iterator parent =
+        dirs_.find(::getParentPath(dir_path));
+    return parent != dirs_.end() && parent.value().indexed &&
+        subdirNames(parent.value().dirents).contains(::getBaseName(dir_path));
+}
+
+void RepoIndex::addToIndex(const QString& dir_path)
+{
+    QMap<QString, Listing>::iterator it = dirs_.find(dir_path);
+    if (it == dirs_.end() || it.value().indexed) {
+        return;
+    }
+    it.value().indexed = true;
+    foreach (const SeafDirent& dirent, it.value().dirents) {
+        addName(dir_path, dirent);
+        if (dirent.isDir()) {
+            addToIndex(::pathJoin(dir_path, dirent.name));
+        }
+    }
+}
+
+void RepoIndex::removeFromIndex(const QString& dir_path)
+{
+    QMap<QString, Listing>::iterator it = dirs_.find(dir_path);
+    if (it == dirs_.end() || !it.value().indexed) {
+        return;
+    }
+    it.value().indexed = false;
+    foreach (const SeafDirent& dirent, it.value().dirents) {
+        removeName(dir_path, dirent);
+        if (dirent.isDir()) {
+            removeFromIndex(::pathJoin(dir_path, dirent.name));
+        }
+    }
+}
+
+void RepoIndex::addName(const QString& dir_path, const SeafDirent& dirent)
+{
+    Entry entry;
+    entry.path = ::pathJoin(dir_path, dirent.name);
+    entry.is_dir = dirent.isDir();
+    names_.insert(dirent.name.toCaseFolded(), entry);
+}
+
+void RepoIndex::removeName(const QString& dir_path, const SeafDirent& dirent)
+{
+    QString path = ::pathJoin(dir_path, dirent.name);
+    QString name = dirent.name.toCaseFolded();
+    QMultiMap<QString, Entry>::iterator it = names_.find(name);
+    while (it != names_.end() && it.key() == name) {
+        if (it.value().path == path) {
+            names_.erase(it);
+            return;
+        }
+        ++it;
+    }
+}
+
+QList<RepoIndex::Entry> RepoIndex::search(const QString& pattern, int max_results) const
+{
+    QList<Entry> results;
+    QString folded = pattern.toCaseFolded();
+    if (folded.isEmpty() || folded.contains(kNameSeparator)) {
+        return results;
+    }
+
+    // the names starting with the pattern are adjacent in names_
+    QMultiMap<QString, Entry>::const_iterator it = names_.lowerBound(folded);
+    for (; it != names_.end() && results.size() < max_results; ++it) {
+        if (!it.key().startsWith(folded)) {
+            break;
+        }
+        results.push_back(it.value());
+    }
+
+    // then the names containing it, scanned in a single string per folder
+    // so there is no per name overhead
+    QMap<QString, Listing>::const_iterator dir;
+    for (dir = dirs_.begin(); dir != dirs_.end(); ++dir) {
+        const Listing& listing = dir.value();
+        if (!listing.indexed) {
+            continue;
+        }
+        int from = 0;
+        while (results.size() < max_results) {
+            int pos = listing.names.indexOf(folded, from);
+            if (pos < 0) {
+                break;
+            }
+            int i = qUpperBound(listing.offsets.constBegin(),
+                                listing.offsets.constEnd(), pos)
+                - listing.offsets.constBegin() - 1;
+            const SeafDirent& dirent = listing.dirents[i];
+            // the names starting with it are found above
+            if (pos != listing.offsets[i]) {
+                Entry entry;
+                entry.path = ::pathJoin(dir.key(), dirent.name);
+                entry.is_dir = dirent.isDir();
+                results.push_back(entry);
+            }
+            from = i + 1 < listing.offsets.size() ?
+                listing.offsets[i + 1] : listing.names.size();
+        }
+    }
+
+    return results;
+}
+
+RepoIndexer::RepoIndexer(const Account& account, const QString& repo_id,
+                         QObject *parent)
+    : QObject(parent),
+      account_(account),
+      repo_id_(repo_id),
+      started_(false)
+{
+}
+
+RepoIndexer::~RepoIndexer()
+{
+}
+
+void RepoIndexer::start()
+{
+    if (started_) {
+        return;
+    }
+    started_ = true;
+
+    QHash<QString, DirentsCacheDB::Listing> listings =
+        DirentsCacheDB::instance()->getAllDirents(repo_id_);
+    QHash<QString, DirentsCacheDB::Listing>::const_iterator it;
+    for (it = listings.begin(); it != listings.end(); ++it) {
+        index_.setDirents(it.key(), it.value().dir_id, it.value().dirents);
+    }
+
+    queue_.push_back("/");
+    indexNext();
+}
+
+void RepoIndexer::updateDirents(const QString& path,
+                                const QString& dir_id,
+                                const QList<SeafDirent>& dirents)
+{
+    index_.setDirents(path, dir_id, dirents);
+}
+
+QList<RepoIndex::Entry> RepoIndexer::search(const QString& pattern, int max_results)
+{
+    return index_.search(pattern, max_results);
+}
+
+void RepoIndexer::indexNext()
+{
+    if (!req_.isNull()) {
+        return;
+    }
+    if (queue_.isEmpty()) {
+        qDebug("indexed %d files and folders of library %s\n",
+               index_.size(), toCStr(repo_id_));
+        emit finished();
+        return;
+    }
+
+    QString path = queue_.takeFirst();
+    req_.reset(new GetDirentsRequest(account_, repo_id_, path, index_.dirId(path)));
+    req_->setPriority(SeafileApiRequest::PRIORITY_BACKGROUND);
+    connect(req_.data(), SIGNAL(success(const QList<SeafDirent>&)),
+            this, SLOT(onGetDirentsSuccess(const QList<SeafDirent>&)));
+    connect(req_.data(), SIGNAL(notModified()),
+            this, SLOT(onGetDirentsNotModified()));
+    connect(req_.data(), SIGNAL(failed(const ApiError&)),
+            this, SLOT(onGetDirentsFailed()));
+    req_->send();
+}
+
+void RepoIndexer::onGetDirentsSuccess(const QList<SeafDirent>& dirents)
+{
+    QString path = req_->path();
+    index_.setDirents(path, req_->dirId(), dirents);
+    DirentsCacheDB::instance()->saveDirents(account_.getSignature(), repo_id_,
+                                            path, req_->dirId(), dirents);
+
+    // only the sub folders whose ids changed need to be fetched again
+    enqueueChangedSubdirs(path);
+
+    // we are in a signal handler of the request, don't delete it right now
+    req_.take()->deleteLater();
+    indexNext();
+}
+
+void RepoIndexer::onGetDirentsNotModified()
+{
+    // the folder itself has not changed, but the last walk may have been
+    // interrupted before all of it was indexed
+    enqueueChangedSubdirs(req_->path());
+
+    req_.take()->deleteLater();
+    indexNext();
+}
+
+void RepoIndexer::onGetDirentsFailed()
+{
+    qWarning("failed to index folder %s of library %s\n",
+             toCStr(req_->path()), toCStr(repo_id_));
+    req_.take()->deleteLater();
+    indexNext();
+}
+
+void RepoIndexer::enqueueChangedSubdirs(const QString& path)
+{
+    QStringList dirs(path);
+    while (!dirs.isEmpty()) {
+        QString dir = dirs.takeFirst();
+        foreach (const SeafDirent& dirent, index_.dirents(dir)) {
+            if (!dirent.isDir()) {
+                continue;
+            }
+            // The id of a folder changes with anything under it, so a sub
+            // folder indexed with the id listed in its parent is up to date,
+            // except maybe its own sub folders. Any other one is fetched.
+            QString subdir = ::pathJoin(dir, dirent.name);
+            if (index_.hasDirents(subdir) && index_.dirId(subdir) == dirent.id) {
+                dirs.push_back(subdir);
+            } else {
+                queue_.push_back(subdir);
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef SEAFILE_CLIENT_FILE_BROWSER_REPO_INDEX_H
+#define SEAFILE_CLIENT_FILE_BROWSER_REPO_INDEX_H
+
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QVector>
+#include <QStringList>
+#include <QScopedPointer>
+
+#include "account.h"
+#include "seaf-dirent.h"
+
+class GetDirentsRequest;
+
+/**
+ * An index of the names of all the files and folders of a library, built
+ * from the dirents of its folders, for searching files by name.
+ *
+ * Only the folders reachable from the root are indexed, so the dirents of
+ * removed folders are simply ignored. The index is updated in place when
+ * the dirents of a folder are changed: only the names of that folder, and
+ * of the sub folders added to or removed from it, are touched.
+ */
+class RepoIndex {
+public:
+    struct Entry {
+        QString path;
+        bool is_dir;
+    };
+
+    void setDirents(const QString& dir_path,
+                    const QString& dir_id,
+                    const QList<SeafDirent>& dirents);
+    bool hasDirents(const QString& dir_path) const;
+    QString dirId(const QString& dir_path) const;
+    QList<SeafDirent> dirents(const QString& dir_path) const;
+
+    // Search the names case insensitively. The names starting with
+    // `pattern` come first, followed by the names containing it.
+    QList<Entry> search(const QString& pattern, int max_results) const;
+    int size() const { return names_.size(); }
+
+private:
+    struct Listing {
+        Listing() : indexed(false) {}
+
+        QString dir_id;
+        QList<SeafDirent> dirents;
+        // whether the folder is reachable from the root, so its names are
+        // in the index
+        bool indexed;
+        // the case folded names of the dirents, separated by '\0', and the
+        // offset of each of them
+        QString names;
+        QVector<int> offsets;
+    };
+
+    bool isReachable(const QString& dir_path) const;
+    void addToIndex(const QString& dir_path);
+    void removeFromIndex(const QString& dir_path);
+    void addName(const QString& dir_path, const SeafDirent& dirent);
+    void removeName(const QString& dir_path, const SeafDirent& dirent);
+
+    QMap<QString, Listing> dirs_;
+    // the entries of the indexed folders, by their case folded names
+    QMultiMap<QString, Entry> names_;
+};
+
+/**
+ * Walk a library in the background to keep its RepoIndex up to date.
+ *
+ * The dirents are saved in DirentsCacheDB, so the index is loaded from the
+ * disk the next time, and only revalidated with the server. The id of a
+ * folder changes whenever anything under it changes, so the folders which
+ * are not modified since the last walk are skipped with all their sub
+ * folders.
+ */
+class RepoIndexer : public QObject {
+    Q_OBJECT
+public:
+    RepoIndexer(const Account& account, const QString& repo_id,
+                QObject *parent=0);
+    ~RepoIndexer();
+
+    const QString& repoId() const { return repo_id_; }
+    bool isIndexing() const { return !req_.isNull() || !queue_.isEmpty(); }
+
+    void start();
+
+    // Update the index with the dirents fetched by the file browser
+    void updateDirents(const QString& path,
+                       const QString& dir_id,
+                       const QList<SeafDirent>& dirents);
+
+    QList<RepoIndex::Entry> search(const QString& pattern, int max_results);
+
+signals:
+    void finished();
+
+private slots:
+    void onGetDirentsSuccess(const QList<SeafDirent>& dirents);
+    void onGetDirentsNotModified();
+    void onGetDirentsFailed();
+
+private:
+    Q_DISABLE_COPY(RepoIndexer)
+
+    void indexNext();
+    void enqueueChangedSubdirs(const QString& path);
+
+    const Account account_;
+    const QString repo_id_;
+    bool started_;
+
+    RepoIndex index_;
+    QStringList queue_;
+    QScopedPointer<GetDirentsRequest> req_;
+};
+
+#endif // SEAFILE_CLIENT_FILE_BROWSER_REPO_INDEX_H
@@ -34,3 +34,27 @@ QList<SeafDirent> SeafDirent::listFromJSON(const json_t *json, json_error_t *err
 
     return dirents;
 }
+
+json_t *SeafDirent::toJSON() const
+{
+    json_t *object = json_object();
+    json_object_set_new(object, "id", json_string(id.toUtf8().data()));
+    json_object_set_new(object, "name", json_string(name.toUtf8().data()));
+    json_object_set_new(object, "type", json_string(isFile() ? "file" : "dir"));
+    if (isFile()) {
+        json_object_set_new(object, "size", json_integer(size));
+    }
+    json_object_set_new(object, "mtime", json_integer(mtime));
+
+    return object;
+}
+
+json_t *SeafDirent::listToJSON(const QList<SeafDirent>& dirents)
+{
+    json_t *array = json_array();
+    foreach (const SeafDirent& dirent, dirents) {
+        json_array_append_new(array, dirent.toJSON());
+    }
+
+    return array;
+}
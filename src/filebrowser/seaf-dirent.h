@@ -26,6 +26,10 @@ public:
 
     static SeafDirent fromJSON(const json_t*, json_error_t *error);
     static QList<SeafDirent> listFromJSON(const json_t*, json_error_t *error);
+
+    // The reverse of fromJSON/listFromJSON, the caller owns the reference
+    json_t *toJSON() const;
+    static json_t *listToJSON(const QList<SeafDirent>& dirents);
 };
 
 
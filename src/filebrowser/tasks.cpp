@@ -1,4 +1,6 @@
 #include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
@@ -12,33 +14,134 @@
 #include <QSslCertificate>
 #include <QDirIterator>
 #include <QTimer>
+#include <QRegExp>
+#include <QDateTime>
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+#include <fcntl.h>
+#endif
 
 #include "utils/utils.h"
 #include "utils/file-utils.h"
+#include "utils/mapped-file-device.h"
 #include "seafile-applet.h"
+#include "settings-mgr.h"
 #include "certs-mgr.h"
 #include "api/api-error.h"
 #include "configurator.h"
-#include "network-mgr.h"
 #include "file-browser-requests.h"
+#include "transfer-worker-pool.h"
 
 #include "tasks.h"
 
 namespace {
 
 const char *kFileDownloadTmpDirName = "fcachetmp";
+const char *kPartialFileSuffix = ".part";
 
 const char *kParentDirParam = "form-data; name=\"parent_dir\"";
 const char *kTargetFileParam = "form-data; name=\"target_file\"";
 const char *kRelativePathParam = "form-data; name=\"relative_path\"";
 const char *kFileParamTemplate = "form-data; name=\"file\"; filename=\"%1\"";
 const char *kContentTypeApplicationOctetStream = "application/octet-stream";
+const char *kChunkContentDispositionTemplate = "attachment; filename=\"%1\"";
 
 const int kMaxRedirects = 3;
 
-} // namesapce
+// Downloads are read and written in blocks of this size
+const qint64 kDownloadBlockSize = 64 * 1024;
+// Cap of the bytes buffered by the QNetworkReply of a download
+const qint64 kDownloadReadBufferSize = 1024 * 1024;
+// Cap of the bytes waiting to be written by the disk io thread
+const qint64 kMaxPendingWriteBytes = 4 * 1024 * 1024;
+// Times to download a file again if the downloaded file is corrupted
+const int kMaxVerifyRetries = 2;
+
+// Upload links stay valid until their access tokens expire on the server
+// (after an hour), so they are shared by the upload tasks for a while
+const qint64 kFileLinkCacheTTLMSecs = 10 * 60 * 1000;
 
-QThread* FileNetworkTask::worker_thread_;
+struct CachedFileLink {
+    QString link;
+    qint64 expire_time;
+};
+
+// Only used in the main thread
+QHash<QString, CachedFileLink> cached_file_links;
+
+QString getCachedFileLink(const QString& key)
+{
+    QHash<QString, CachedFileLink>::iterator it = cached_file_links.find(key);
+    if (it == cached_file_links.end()) {
+        return QString();
+    }
+    if (it->expire_time < QDateTime::currentMSecsSinceEpoch()) {
+        cached_file_links.erase(it);
+        return QString();
+    }
+    return it->link;
+}
+
+void cacheFileLink(const QString& key, const QString& link)
+{
+    CachedFileLink cached;
+    cached.link = link;
+    cached.expire_time = QDateTime::currentMSecsSinceEpoch() + kFileLinkCacheTTLMSecs;
+    cached_file_links[key] = cached;
+}
+
+// The folder of a relative path and all of its ancestors, e.g. "a", "a/b"
+// and "a/b/c" for "a/b/c"
+QStringList foldersOf(const QString& relative_path)
+{
+    QStringList folders;
+    QString folder;
+    Q_FOREACH(const QString& name, relative_path.split('/', QString::SkipEmptyParts)) {
+        folder = folder.isEmpty() ? name : folder + "/" + name;
+        folders.push_back(folder);
+    }
+    return folders;
+}
+
+QMutex disk_io_thread_mutex;
+QThread *disk_io_thread;
+
+// Files larger than this are uploaded in chunks, if the server supports it
+const qint64 kChunkedUploadThreshold = 64 * 1024 * 1024;
+const qint64 kUploadChunkSize = 8 * 1024 * 1024;
+const int kMaxChunkRetries = 3;
+const int kChunkRetryDelayMSecs = 3000;
+
+// The server rejects a chunk which doesn't continue the partial upload it
+// has, e.g. when it has dropped it, with one of these. The other errors,
+// such as the 400 and 403 of an expired upload link, keep the offset.
+bool isPartialUploadLost(int code)
+{
+    return code == 409 || code == 416;
+}
+
+// The offsets acknowledged by the server of interrupted chunked uploads,
+// shared by all worker threads
+QMutex upload_offsets_mutex;
+QHash<QString, qint64> upload_offsets;
+
+qint64 getUploadOffset(const QString& key)
+{
+    QMutexLocker lock(&upload_offsets_mutex);
+    return upload_offsets.value(key, 0);
+}
+
+void setUploadOffset(const QString& key, qint64 offset)
+{
+    QMutexLocker lock(&upload_offsets_mutex);
+    if (offset > 0) {
+        upload_offsets[key] = offset;
+    } else {
+        upload_offsets.remove(key);
+    }
+}
+
+} // namesapce
 
 FileNetworkTask::FileNetworkTask(const Account& account,
                                  const QString& repo_id,
@@ -49,6 +152,7 @@ FileNetworkTask::FileNetworkTask(const Account& account,
       path_(path),
       local_path_(local_path),
       canceled_(false),
+      link_from_cache_(false),
       progress_(0, 0),
       __shared_ptr(this, &QObject::deleteLater),
       __weak_ptr(__shared_ptr)
@@ -75,6 +179,21 @@ QString FileNetworkTask::fileName() const
 
 void FileNetworkTask::start()
 {
+    QString key = linkCacheKey();
+    if (!key.isEmpty() && canUseCachedLink()) {
+        QString link = getCachedFileLink(key);
+        if (!link.isEmpty()) {
+            link_from_cache_ = true;
+            startFileServerTask(link);
+            return;
+        }
+    }
+    sendGetLinkRequest();
+}
+
+void FileNetworkTask::sendGetLinkRequest()
+{
+    link_from_cache_ = false;
     createGetLinkRequest();
     connect(get_link_req_, SIGNAL(success(const QString&)),
             this, SLOT(onLinkGet(const QString&)));
@@ -92,6 +211,10 @@ void FileNetworkTask::onFileServerTaskProgressUpdate(qint64 transferred, qint64
 
 void FileNetworkTask::onLinkGet(const QString& link)
 {
+    QString key = linkCacheKey();
+    if (!key.isEmpty()) {
+        cacheFileLink(key, link);
+    }
     startFileServerTask(link);
 }
 
@@ -104,12 +227,8 @@ void FileNetworkTask::startFileServerTask(const QString& link)
     connect(fileserver_task_, SIGNAL(finished(bool)),
             this, SLOT(onFileServerTaskFinished(bool)));
 
-    if (!worker_thread_) {
-        worker_thread_ = new QThread;
-        worker_thread_->start();
-    }
     // From now on the transfer task would run in the worker thread
-    fileserver_task_->moveToThread(worker_thread_);
+    TransferWorkerPool::instance()->assignTask(fileserver_task_);
     QMetaObject::invokeMethod(fileserver_task_, "start");
 }
 
@@ -133,6 +252,21 @@ void FileNetworkTask::onFileServerTaskFinished(bool success)
     if (canceled_) {
         return;
     }
+    int code = fileserver_task_->httpErrorCode();
+    // the fileserver rejects an expired or unknown token with 403 (or 400
+    // with older servers), the other errors are not fixed by a new link
+    if (!success && (code == 403 || code == 400) && !linkCacheKey().isEmpty()) {
+        // the link may have expired on the server
+        cached_file_links.remove(linkCacheKey());
+        if (link_from_cache_) {
+            qDebug("the cached link of %s is rejected (%d), get a new one\n",
+                   toCStr(path_), code);
+            fileserver_task_->deleteLater();
+            fileserver_task_ = NULL;
+            sendGetLinkRequest();
+            return;
+        }
+    }
     if (!success) {
         error_ = fileserver_task_->error();
         error_string_ = fileserver_task_->errorString();
@@ -195,7 +329,7 @@ void FileDownloadTask::onLinkGet(const QString& link)
 
 void FileDownloadTask::createFileServerTask(const QString& link)
 {
-    fileserver_task_ = new GetFileTask(link, local_path_);
+    fileserver_task_ = new GetFileTask(link, local_path_, repo_id_, path_, file_id_);
 }
 
 FileUploadTask::FileUploadTask(const Account& account,
@@ -222,10 +356,21 @@ void FileUploadTask::createGetLinkRequest()
     get_link_req_ = new GetFileUploadLinkRequest(account_, repo_id_, use_upload_);
 }
 
+QString FileUploadTask::linkCacheKey() const
+{
+    return QString("%1:%2:%3").arg(account_.getSignature())
+        .arg(repo_id_).arg(use_upload_ ? "upload" : "update");
+}
+
 void FileUploadTask::createFileServerTask(const QString& link)
 {
-    fileserver_task_ = new PostFileTask(link, path_, local_path_,
-                                        name_, use_upload_);
+    PostFileTask *task = new PostFileTask(link, path_, local_path_,
+                                          name_, use_upload_);
+    // the update api does not support chunked uploads
+    task->setChunkedUpload(use_upload_ &&
+                           account_.isAtLeastVersion(5, 1, 0) &&
+                           QFileInfo(local_path_).size() > kChunkedUploadThreshold);
+    fileserver_task_ = task;
 }
 
 FileUploadMultipleTask::FileUploadMultipleTask(const Account& account,
@@ -241,7 +386,8 @@ FileUploadMultipleTask::FileUploadMultipleTask(const Account& account,
 
 void FileUploadMultipleTask::createFileServerTask(const QString& link)
 {
-    fileserver_task_ = new PostFilesTask(link, path_, local_path_, names_, false);
+    fileserver_task_ = new PostFilesTask(link, path_, local_path_, names_, false,
+        seafApplet->settingsManager()->maxConcurrentFileUploads());
 }
 
 FileUploadDirectoryTask::FileUploadDirectoryTask(const Account& account,
@@ -267,17 +413,18 @@ void FileUploadDirectoryTask::createFileServerTask(const QString& link)
            names.push_back(dir.relativeFilePath(iterator.filePath()));
     }
 
-    fileserver_task_ = new PostFilesTask(link, path_, dir.absolutePath(), names, true);
+    fileserver_task_ = new PostFilesTask(link, path_, dir.absolutePath(), names, true,
+        seafApplet->settingsManager()->maxConcurrentFileUploads());
 }
 
 
-QNetworkAccessManager* FileServerTask::network_mgr_;
-
 FileServerTask::FileServerTask(const QUrl& url, const QString& local_path)
     : url_(url),
       local_path_(local_path),
+      reply_(NULL),
       canceled_(false),
       redirect_count_(0),
+      error_(FileNetworkTask::NoError),
       http_error_code_(0)
 {
 }
@@ -303,6 +450,10 @@ void FileServerTask::onSslErrors(const QList<QSslError>& errors)
 void FileServerTask::start()
 {
     prepare();
+    // prepare() has already emitted finished(false) on error
+    if (error_ != FileNetworkTask::NoError) {
+        return;
+    }
     sendRequest();
 }
 
@@ -318,6 +469,9 @@ void FileServerTask::httpRequestFinished()
 {
     int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     if (code == 0 && reply_->error() != QNetworkReply::NoError) {
+        if (!canceled_ && handleHttpError(0)) {
+            return;
+        }
         qWarning("[file server task] network error: %s\n", toCStr(reply_->errorString()));
         setError(FileNetworkTask::ApiRequestError, reply_->errorString());
         emit finished(false);
@@ -329,6 +483,9 @@ void FileServerTask::httpRequestFinished()
     }
 
     if ((code / 100) == 4 || (code / 100) == 5) {
+        if (handleHttpError(code)) {
+            return;
+        }
         qWarning("request failed for %s: status code %d\n",
                toCStr(reply_->url().toString()), code);
         setHttpError(code);
@@ -339,6 +496,11 @@ void FileServerTask::httpRequestFinished()
     onHttpRequestFinished();
 }
 
+QNetworkAccessManager *FileServerTask::networkManager() const
+{
+    return TransferWorkerPool::networkManager();
+}
+
 bool FileServerTask::handleHttpRedirect()
 {
     QVariant redirect_attr = reply_->attribute(QNetworkRequest::RedirectionTargetAttribute);
@@ -367,17 +529,132 @@ bool FileServerTask::handleHttpRedirect()
 }
 
 
-GetFileTask::GetFileTask(const QUrl& url, const QString& local_path)
+DownloadFileWriter::DownloadFileWriter(QFile *file, bool keep_partial_file)
+    : file_(file),
+      keep_partial_file_(keep_partial_file),
+      failed_(false)
+{
+}
+
+DownloadFileWriter::~DownloadFileWriter()
+{
+    if (file_) {
+        file_->close();
+        // keep the partial file so that the next download can resume it
+        if (!keep_partial_file_ || file_->size() == 0) {
+            file_->remove();
+        }
+        delete file_;
+    }
+}
+
+QThread *DownloadFileWriter::diskIOThread()
+{
+    QMutexLocker lock(&disk_io_thread_mutex);
+    if (!disk_io_thread) {
+        disk_io_thread = new QThread;
+        disk_io_thread->start();
+    }
+    return disk_io_thread;
+}
+
+void DownloadFileWriter::writeBlock(const QByteArray& block)
+{
+    if (failed_) {
+        return;
+    }
+    if (file_->write(block) != block.size()) {
+        failed_ = true;
+        emit writeFailed(tr("Failed to write file to disk"));
+        return;
+    }
+    emit blockWritten(block.size());
+}
+
+void DownloadFileWriter::truncate()
+{
+    file_->resize(0);
+    file_->seek(0);
+}
+
+void DownloadFileWriter::preallocate(qint64 size)
+{
+    qint64 current_size = file_->size();
+    if (size <= current_size) {
+        return;
+    }
+#if defined(Q_OS_LINUX)
+    fallocate(file_->handle(), FALLOC_FL_KEEP_SIZE, current_size, size - current_size);
+#elif defined(Q_OS_MAC)
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, size - current_size, 0};
+    fcntl(file_->handle(), F_PREALLOCATE, &store);
+#endif
+}
+
+void DownloadFileWriter::commit(const QString& local_path, qint64 expected_size)
+{
+    if (failed_) {
+        return;
+    }
+
+    if (expected_size >= 0 && file_->size() != expected_size) {
+        emit verificationFailed(QString("expected %1 bytes, but got %2 bytes")
+                                .arg(expected_size).arg(file_->size()),
+                                file_->size());
+        return;
+    }
+
+    file_->close();
+
+    QString parent_dir = ::getParentPath(local_path);
+    if (!::createDirIfNotExists(parent_dir)) {
+        emit committed(false, tr("Failed to write file to disk"));
+        return;
+    }
+
+    QFile oldfile(local_path);
+    if (oldfile.exists() && !oldfile.remove()) {
+        emit committed(false, tr("Failed to remove the older version of the downloaded file"));
+        return;
+    }
+
+    if (!file_->rename(local_path)) {
+        emit committed(false, tr("Failed to move file"));
+        return;
+    }
+
+    delete file_;
+    file_ = NULL;
+    emit committed(true, QString());
+}
+
+GetFileTask::GetFileTask(const QUrl& url,
+                         const QString& local_path,
+                         const QString& repo_id,
+                         const QString& path,
+                         const QString& file_id)
     : FileServerTask(url, local_path),
-      tmp_file_(NULL)
+      repo_id_(repo_id),
+      path_(path),
+      file_id_(file_id),
+      writer_(NULL),
+      file_size_(0),
+      pending_bytes_(0),
+      resume_offset_(0),
+      preallocated_(false),
+      reply_finished_(false),
+      committing_(false),
+      response_checked_(false),
+      expected_size_(-1),
+      verify_retries_(0)
 {
 }
 
 GetFileTask::~GetFileTask()
 {
-    if (tmp_file_) {
-        tmp_file_->remove();
-        delete tmp_file_;
+    if (writer_) {
+        // the writer is deleted after all its pending blocks are written
+        writer_->deleteLater();
     }
 }
 
@@ -391,79 +668,331 @@ void GetFileTask::prepare()
         return;
     }
 
-    QString tmpf_path = ::pathJoin(download_tmp_dir, "seaf-XXXXXX");
-    tmp_file_ = new QTemporaryFile(tmpf_path);
-    tmp_file_->setAutoRemove(false);
-    if (!tmp_file_->open()) {
+    QFile *tmp_file;
+    if (resumable()) {
+        // The partial file is named as "<md5(repo_id + path)>-<file_id>.part",
+        // partial files of other versions of the same file are useless now.
+        QString prefix = ::md5(repo_id_ + path_) + "-";
+        QString name = prefix + file_id_ + kPartialFileSuffix;
+        QDir dir(download_tmp_dir);
+        foreach (const QString& stale, dir.entryList(QStringList(prefix + "*"), QDir::Files)) {
+            if (stale != name) {
+                dir.remove(stale);
+            }
+        }
+        tmp_file = new QFile(::pathJoin(download_tmp_dir, name));
+    } else {
+        QTemporaryFile *tmp =
+            new QTemporaryFile(::pathJoin(download_tmp_dir, "seaf-XXXXXX"));
+        tmp->setAutoRemove(false);
+        tmp_file = tmp;
+    }
+
+    // blocks are always written in full, so skip the buffer of QFile
+    if (!tmp_file->open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        delete tmp_file;
         setError(FileNetworkTask::FileIOError, tr("Failed to create temporary files"));
         emit finished(false);
+        return;
     }
+    file_size_ = tmp_file->size();
+    tmp_file->seek(file_size_);
+
+    writer_ = new DownloadFileWriter(tmp_file, resumable());
+    writer_->moveToThread(DownloadFileWriter::diskIOThread());
+    connect(writer_, SIGNAL(blockWritten(qint64)),
+            this, SLOT(onBlockWritten(qint64)));
+    connect(writer_, SIGNAL(writeFailed(const QString&)),
+            this, SLOT(onWriteFailed(const QString&)));
+    connect(writer_, SIGNAL(verificationFailed(const QString&, qint64)),
+            this, SLOT(onVerificationFailed(const QString&, qint64)));
+    connect(writer_, SIGNAL(committed(bool, const QString&)),
+            this, SLOT(onCommitted(bool, const QString&)));
 }
 
 void GetFileTask::sendRequest()
 {
     QNetworkRequest request(url_);
-    if (!network_mgr_) {
-        static QNetworkAccessManager manager;
-        network_mgr_ = &manager;
-        NetworkManager::instance()->addWatch(network_mgr_);
+    resume_offset_ = file_size_;
+    preallocated_ = false;
+    reply_finished_ = false;
+    response_checked_ = false;
+    expected_size_ = -1;
+    if (resume_offset_ > 0) {
+        qDebug("resume downloading %s from offset %lld\n",
+               toCStr(path_), resume_offset_);
+        request.setRawHeader("Range",
+                             QString("bytes=%1-").arg(resume_offset_).toUtf8());
     }
-    reply_ = network_mgr_->get(request);
+    reply_ = networkManager()->get(request);
+    // when the buffer is full, the reply stops reading from the socket until
+    // we have consumed some data
+    reply_->setReadBufferSize(kDownloadReadBufferSize);
 
     connect(reply_, SIGNAL(sslErrors(const QList<QSslError>&)),
             this, SLOT(onSslErrors(const QList<QSslError>&)));
 
     connect(reply_, SIGNAL(readyRead()), this, SLOT(httpReadyRead()));
     connect(reply_, SIGNAL(downloadProgress(qint64, qint64)),
-            this, SIGNAL(progressUpdate(qint64, qint64)));
+            this, SLOT(onDownloadProgress(qint64, qint64)));
     connect(reply_, SIGNAL(finished()), this, SLOT(httpRequestFinished()));
 }
 
+/**
+ * Discard the partial file and download the whole file again
+ */
+void GetFileTask::restartDownload()
+{
+    QMetaObject::invokeMethod(writer_, "truncate");
+    file_size_ = 0;
+    sendRequest();
+}
+
+/**
+ * Check the headers of the response once, before any of its data is handed
+ * to the writer. Return false if the response is not usable.
+ */
+bool GetFileTask::checkResponse()
+{
+    if (response_checked_) {
+        return true;
+    }
+    if (!checkResponseRange() || !checkResponseETag()) {
+        return false;
+    }
+    parseExpectedSize();
+    response_checked_ = true;
+    return true;
+}
+
+/**
+ * Make sure the body of the reply continues exactly where the partial file
+ * ends. Return false if the request has been restarted from the beginning.
+ */
+bool GetFileTask::checkResponseRange()
+{
+    int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (code == 206) {
+        QRegExp range_re("^bytes (\\d+)-");
+        QString content_range = reply_->rawHeader("Content-Range");
+        if (range_re.indexIn(content_range) != 0 ||
+            range_re.cap(1).toLongLong() != resume_offset_) {
+            qWarning("unexpected content range \"%s\" for %s, restart downloading\n",
+                     toCStr(content_range), toCStr(path_));
+            reply_->disconnect(this);
+            reply_->abort();
+            reply_->deleteLater();
+            restartDownload();
+            return false;
+        }
+    } else if (code == 200 && resume_offset_ > 0) {
+        // the server ignores the range header and sends the whole file
+        QMetaObject::invokeMethod(writer_, "truncate");
+        file_size_ = 0;
+        resume_offset_ = 0;
+    }
+    return true;
+}
+
+/**
+ * The file server sends the file id as the "ETag" of the file. Make sure we
+ * are receiving the version of the file we have asked for.
+ */
+bool GetFileTask::checkResponseETag()
+{
+    if (!resumable()) {
+        return true;
+    }
+    QString etag = reply_->rawHeader("ETag");
+    etag.remove(QRegExp("^W/")).remove('"');
+    // a proxy in between may have replaced the etag with its own one
+    if (!QRegExp("[0-9a-f]{40}").exactMatch(etag) || etag == file_id_) {
+        return true;
+    }
+    qWarning("unexpected etag \"%s\" for %s (file id %s)\n",
+             toCStr(etag), toCStr(path_), toCStr(file_id_));
+    canceled_ = true;
+    reply_->disconnect(this);
+    reply_->abort();
+    setError(FileNetworkTask::ApiRequestError, tr("The file has been changed on the server"));
+    emit finished(false);
+    return false;
+}
+
+/**
+ * Find out the size of the whole file from the headers of the response, which
+ * is checked before the file is moved to its location.
+ */
+void GetFileTask::parseExpectedSize()
+{
+    int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (code == 206) {
+        QRegExp total_re("/(\\d+)$");
+        QString content_range = reply_->rawHeader("Content-Range");
+        if (total_re.indexIn(content_range) >= 0) {
+            expected_size_ = total_re.cap(1).toLongLong();
+        }
+    } else {
+        QVariant length = reply_->header(QNetworkRequest::ContentLengthHeader);
+        if (length.isValid()) {
+            expected_size_ = resume_offset_ + length.toLongLong();
+        }
+    }
+}
+
+bool GetFileTask::handleHttpError(int code)
+{
+    // 416 Range Not Satisfiable: the partial file is not usable anymore
+    if (code != 416 || resume_offset_ == 0) {
+        return false;
+    }
+    qWarning("failed to resume downloading %s, restart downloading\n",
+             toCStr(path_));
+    reply_->deleteLater();
+    restartDownload();
+    return true;
+}
+
 void GetFileTask::httpReadyRead()
 {
     if (canceled_) {
         return;
     }
-    // TODO: read in blocks (e.g 64k) instead of readAll
-    // TODO: check http status code
-    QByteArray chunk = reply_->readAll();
-    if (!chunk.isEmpty()) {
-        if (tmp_file_->write(chunk) <= 0) {
-            setError(FileNetworkTask::FileIOError, tr("Failed to create folders"));
-            emit finished(false);
+    // skip the body of redirects and error pages
+    int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((code / 100) != 2 || !checkResponse()) {
+        return;
+    }
+
+    if (!preallocated_) {
+        preallocated_ = true;
+        qint64 length = reply_->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+        if (length > 0) {
+            QMetaObject::invokeMethod(writer_, "preallocate",
+                                      Q_ARG(qint64, file_size_ + length));
         }
     }
+
+    readBlocks();
 }
 
-void GetFileTask::onHttpRequestFinished()
+/**
+ * Hand the data of the reply to the writer in blocks of kDownloadBlockSize,
+ * until kMaxPendingWriteBytes are waiting to be written. The rest of the
+ * data is left in the reply, which would be read in onBlockWritten.
+ */
+void GetFileTask::readBlocks()
 {
+    while (pending_bytes_ < kMaxPendingWriteBytes) {
+        qint64 available = reply_->bytesAvailable();
+        // only the last block may be smaller than the block size
+        if (available == 0 ||
+            (available < kDownloadBlockSize && !reply_->isFinished())) {
+            break;
+        }
+        QByteArray block = reply_->read(kDownloadBlockSize);
+        if (block.isEmpty()) {
+            break;
+        }
+        pending_bytes_ += block.size();
+        file_size_ += block.size();
+        QMetaObject::invokeMethod(writer_, "writeBlock", Q_ARG(QByteArray, block));
+    }
+}
+
+void GetFileTask::onBlockWritten(qint64 bytes)
+{
+    pending_bytes_ -= bytes;
     if (canceled_) {
         return;
     }
-    tmp_file_->close();
+    int code = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((code / 100) == 2) {
+        readBlocks();
+    }
+    commitIfDone();
+}
 
-    QString parent_dir = ::getParentPath(local_path_);
-    if (!::createDirIfNotExists(parent_dir)) {
-        setError(FileNetworkTask::FileIOError, tr("Failed to write file to disk"));
-        emit finished(false);
+void GetFileTask::onWriteFailed(const QString& error)
+{
+    if (canceled_) {
+        return;
     }
+    canceled_ = true;
+    reply_->disconnect(this);
+    reply_->abort();
+    setError(FileNetworkTask::FileIOError, error);
+    emit finished(false);
+}
 
-    QFile oldfile(local_path_);
-    if (oldfile.exists() && !oldfile.remove()) {
-        setError(FileNetworkTask::FileIOError, tr("Failed to remove the older version of the downloaded file"));
-        emit finished(false);
+void GetFileTask::onDownloadProgress(qint64 received, qint64 total)
+{
+    if (total >= 0) {
+        total += resume_offset_;
+    }
+    emit progressUpdate(received + resume_offset_, total);
+}
+
+void GetFileTask::onHttpRequestFinished()
+{
+    if (canceled_) {
+        return;
+    }
+    if (!checkResponse()) {
         return;
     }
+    reply_finished_ = true;
+    readBlocks();
+    commitIfDone();
+}
 
-    if (!tmp_file_->rename(local_path_)) {
-        setError(FileNetworkTask::FileIOError, tr("Failed to move file"));
-        emit finished(false);
+void GetFileTask::commitIfDone()
+{
+    if (!reply_finished_ || committing_ ||
+        reply_->bytesAvailable() > 0 || pending_bytes_ > 0) {
         return;
     }
+    committing_ = true;
+    QMetaObject::invokeMethod(writer_, "commit",
+                              Q_ARG(QString, local_path_),
+                              Q_ARG(qint64, expected_size_));
+}
 
-    delete tmp_file_;
-    tmp_file_ = 0;
-    emit finished(true);
+void GetFileTask::onVerificationFailed(const QString& reason, qint64 size)
+{
+    if (canceled_) {
+        return;
+    }
+    qWarning("failed to verify the downloaded file %s: %s\n",
+             toCStr(path_), toCStr(reason));
+    committing_ = false;
+    if (verify_retries_++ < kMaxVerifyRetries) {
+        reply_->deleteLater();
+        if (resumable() && size < expected_size_) {
+            // the response has been cut short, the data received so far is
+            // still good, fetch the rest of it
+            file_size_ = size;
+            sendRequest();
+        } else {
+            restartDownload();
+        }
+        return;
+    }
+    // the partial file is corrupted, don't resume from it next time
+    QMetaObject::invokeMethod(writer_, "truncate");
+    setError(FileNetworkTask::FileIOError, tr("The downloaded file is corrupted"));
+    emit finished(false);
+}
+
+void GetFileTask::onCommitted(bool success, const QString& error)
+{
+    if (canceled_) {
+        return;
+    }
+    if (!success) {
+        setError(FileNetworkTask::FileIOError, error);
+    }
+    emit finished(success);
 }
 
 PostFileTask::PostFileTask(const QUrl& url,
@@ -474,7 +1003,13 @@ PostFileTask::PostFileTask(const QUrl& url,
     : FileServerTask(url, local_path),
       parent_dir_(parent_dir),
       name_(name),
-      use_upload_(use_upload)
+      use_upload_(use_upload),
+      chunked_(false),
+      chunk_offset_(0),
+      chunk_size_(0),
+      file_size_(0),
+      chunk_retries_(0),
+      resumed_(false)
 {
 }
 
@@ -487,7 +1022,13 @@ PostFileTask::PostFileTask(const QUrl& url,
       parent_dir_(parent_dir),
       name_(name),
       use_upload_(true),
-      relative_path_(relative_path)
+      relative_path_(relative_path),
+      chunked_(false),
+      chunk_offset_(0),
+      chunk_size_(0),
+      file_size_(0),
+      chunk_retries_(0),
+      resumed_(false)
 {
 }
 
@@ -497,8 +1038,11 @@ PostFileTask::~PostFileTask()
 
 void PostFileTask::prepare()
 {
-    file_ = new QFile(local_path_);
-    file_->setParent(this);
+    // read the file through a memory mapping instead of QFile's buffering
+    file_ = new MappedFileDevice(local_path_, this);
+    // The updated files are the cached files opened by the user, which may
+    // be truncated by the editor while being uploaded
+    file_->setMapEnabled(use_upload_);
     if (!file_->exists()) {
         setError(FileNetworkTask::FileIOError, tr("File does not exist"));
         emit finished(false);
@@ -509,18 +1053,42 @@ void PostFileTask::prepare()
         emit finished(false);
         return;
     }
+
+    if (chunked_) {
+        file_size_ = file_->size();
+        chunk_offset_ = getUploadOffset(uploadKey());
+        if (chunk_offset_ >= file_size_) {
+            chunk_offset_ = 0;
+        }
+        resumed_ = chunk_offset_ > 0;
+        if (resumed_) {
+            qDebug("resume uploading %s from offset %lld\n",
+                   toCStr(local_path_), chunk_offset_);
+        }
+    }
 }
 
 /**
- * This member function may be called in two places:
- * 1. when task is first started
- * 2. when the request is redirected
+ * The key of the recorded offset. The size and mtime of the file are part of
+ * the key, so an offset is never used for a modified file.
  */
-void PostFileTask::sendRequest()
+QString PostFileTask::uploadKey() const
+{
+    QFileInfo info(local_path_);
+    return ::md5(QString("%1:%2:%3:%4:%5:%6:%7")
+                 .arg(url_.host())
+                 .arg(parent_dir_)
+                 .arg(relative_path_)
+                 .arg(name_)
+                 .arg(local_path_)
+                 .arg(info.size())
+                 .arg(info.lastModified().toMSecsSinceEpoch()));
+}
+
+void PostFileTask::appendFormParams(QHttpMultiPart *multipart)
 {
-    QHttpMultiPart *multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType, this);
     // parent_dir param
-    QHttpPart parentdir_part, file_part;
+    QHttpPart parentdir_part;
     if (use_upload_) {
         parentdir_part.setHeader(QNetworkRequest::ContentDispositionHeader,
                                  kParentDirParam);
@@ -540,8 +1108,25 @@ void PostFileTask::sendRequest()
         part.setBody(relative_path_.toUtf8());
         multipart->append(part);
     }
+}
+
+/**
+ * This member function may be called in two places:
+ * 1. when task is first started
+ * 2. when the request is redirected
+ */
+void PostFileTask::sendRequest()
+{
+    if (chunked_) {
+        sendChunk();
+        return;
+    }
+
+    QHttpMultiPart *multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType, this);
+    appendFormParams(multipart);
 
     // "file" param
+    QHttpPart file_part;
     file_part.setHeader(QNetworkRequest::ContentDispositionHeader,
                         QString(kFileParamTemplate).arg(name_).toUtf8());
     file_part.setHeader(QNetworkRequest::ContentTypeHeader,
@@ -553,12 +1138,7 @@ void PostFileTask::sendRequest()
     QNetworkRequest request(url_);
     request.setRawHeader("Content-Type",
                          "multipart/form-data; boundary=" + multipart->boundary());
-    if (!network_mgr_) {
-        static QNetworkAccessManager manager;
-        network_mgr_ = &manager;
-        NetworkManager::instance()->addWatch(network_mgr_);
-    }
-    reply_ = network_mgr_->post(request, multipart);
+    reply_ = networkManager()->post(request, multipart);
     connect(reply_, SIGNAL(sslErrors(const QList<QSslError>&)),
             this, SLOT(onSslErrors(const QList<QSslError>&)));
     connect(reply_, SIGNAL(finished()), this, SLOT(httpRequestFinished()));
@@ -566,6 +1146,98 @@ void PostFileTask::sendRequest()
             this, SIGNAL(progressUpdate(qint64, qint64)));
 }
 
+/**
+ * Send the range [chunk_offset_, chunk_offset_ + kUploadChunkSize) of the
+ * file. Only one chunk is kept in memory at any time.
+ */
+void PostFileTask::sendChunk()
+{
+    if (canceled_) {
+        return;
+    }
+
+    QByteArray chunk;
+    if (file_->seek(chunk_offset_)) {
+        chunk = file_->read(kUploadChunkSize);
+    }
+    if (chunk.isEmpty()) {
+        setError(FileNetworkTask::FileIOError, tr("Failed to read file"));
+        emit finished(false);
+        return;
+    }
+    chunk_size_ = chunk.size();
+
+    QHttpMultiPart *multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+    appendFormParams(multipart);
+
+    QHttpPart file_part;
+    file_part.setHeader(QNetworkRequest::ContentDispositionHeader,
+                        QString(kFileParamTemplate).arg(name_).toUtf8());
+    file_part.setHeader(QNetworkRequest::ContentTypeHeader,
+                        kContentTypeApplicationOctetStream);
+    file_part.setBody(chunk);
+    multipart->append(file_part);
+
+    QNetworkRequest request(url_);
+    request.setRawHeader("Content-Type",
+                         "multipart/form-data; boundary=" + multipart->boundary());
+    request.setRawHeader("Content-Range",
+                         QString("bytes %1-%2/%3")
+                         .arg(chunk_offset_)
+                         .arg(chunk_offset_ + chunk_size_ - 1)
+                         .arg(file_size_).toUtf8());
+    request.setRawHeader("Content-Disposition",
+                         QString(kChunkContentDispositionTemplate)
+                         .arg(QString(QUrl::toPercentEncoding(name_))).toUtf8());
+    reply_ = networkManager()->post(request, multipart);
+    // free the chunk as soon as the request is done
+    multipart->setParent(reply_);
+    connect(reply_, SIGNAL(sslErrors(const QList<QSslError>&)),
+            this, SLOT(onSslErrors(const QList<QSslError>&)));
+    connect(reply_, SIGNAL(finished()), this, SLOT(httpRequestFinished()));
+    connect(reply_, SIGNAL(uploadProgress(qint64,qint64)),
+            this, SLOT(onChunkUploadProgress(qint64, qint64)));
+}
+
+void PostFileTask::onChunkUploadProgress(qint64 sent, qint64 /* total */)
+{
+    // the multipart overhead makes `sent` slightly larger than the chunk
+    emit progressUpdate(chunk_offset_ + qMin(sent, chunk_size_), file_size_);
+}
+
+bool PostFileTask::handleHttpError(int code)
+{
+    if (!chunked_) {
+        return false;
+    }
+
+    // The server has dropped the partial upload we resumed, start over
+    if (resumed_ && isPartialUploadLost(code)) {
+        qWarning("failed to resume uploading %s, restart uploading\n",
+                 toCStr(local_path_));
+        resumed_ = false;
+        chunk_offset_ = 0;
+        setUploadOffset(uploadKey(), 0);
+        reply_->deleteLater();
+        sendChunk();
+        return true;
+    }
+
+    // Network errors and server errors are likely to be transient, resend
+    // the chunk from the last acknowledged offset
+    if ((code == 0 || (code / 100) == 5) && chunk_retries_ < kMaxChunkRetries) {
+        chunk_retries_++;
+        qWarning("failed to upload the chunk at %lld of %s, retry %d/%d\n",
+                 chunk_offset_, toCStr(local_path_), chunk_retries_, kMaxChunkRetries);
+        reply_->deleteLater();
+        // nothing to abort until the chunk is resent
+        reply_ = NULL;
+        QTimer::singleShot(kChunkRetryDelayMSecs, this, SLOT(sendChunk()));
+        return true;
+    }
+    return false;
+}
+
 void PostFileTask::onHttpRequestFinished()
 {
     if (canceled_) {
@@ -576,6 +1248,18 @@ void PostFileTask::onHttpRequestFinished()
         return;
     }
 
+    if (chunked_) {
+        chunk_offset_ += chunk_size_;
+        chunk_retries_ = 0;
+        if (chunk_offset_ < file_size_) {
+            setUploadOffset(uploadKey(), chunk_offset_);
+            reply_->deleteLater();
+            sendChunk();
+            return;
+        }
+        setUploadOffset(uploadKey(), 0);
+    }
+
     oid_ = reply_->readAll();
 
     emit finished(true);
@@ -585,13 +1269,16 @@ PostFilesTask::PostFilesTask(const QUrl& url,
                              const QString& parent_dir,
                              const QString& local_path,
                              const QStringList& names,
-                             const bool use_relative)
+                             const bool use_relative,
+                             int max_concurrent)
     : FileServerTask(url, local_path),
       // work around with server
       parent_dir_(parent_dir.endsWith('/') ? parent_dir : parent_dir + "/"),
       name_(QFileInfo(local_path_).fileName()),
       names_(names),
-      current_num_(-1),
+      next_num_(0),
+      finished_num_(0),
+      max_concurrent_(qMax(max_concurrent, 1)),
       progress_update_timer_(new QTimer(this)),
       use_relative_(use_relative)
 {
@@ -602,11 +1289,11 @@ PostFilesTask::PostFilesTask(const QUrl& url,
 
 PostFilesTask::~PostFilesTask()
 {
+    cancelRunningTasks();
 }
 
 void PostFilesTask::prepare()
 {
-    current_bytes_ = 0;
     transferred_bytes_ = 0;
     total_bytes_ = 0;
 
@@ -629,69 +1316,148 @@ void PostFilesTask::cancel()
     }
     progress_update_timer_->stop();
     canceled_ = true;
-    task_->cancel();
+    cancelRunningTasks();
+}
+
+void PostFilesTask::cancelRunningTasks()
+{
+    QList<PostFileTask*> tasks = running_tasks_.keys();
+    running_tasks_.clear();
+    Q_FOREACH(PostFileTask *task, tasks)
+    {
+        task->disconnect(this);
+        task->cancel();
+        task->deleteLater();
+    }
 }
 
 void PostFilesTask::sendRequest()
 {
+    progress_update_timer_->start(100);
     startNext();
 }
 
 void PostFilesTask::onProgressUpdate()
 {
-    emit progressUpdate(current_bytes_ + transferred_bytes_, total_bytes_);
+    qint64 bytes = transferred_bytes_;
+    Q_FOREACH(const RunningTask& running, running_tasks_)
+    {
+        bytes += running.bytes;
+    }
+    emit progressUpdate(bytes, total_bytes_);
 }
 
 void PostFilesTask::onPostTaskProgressUpdate(qint64 bytes, qint64 /* sum_bytes */)
 {
-    current_bytes_ = bytes;
+    PostFileTask *task = qobject_cast<PostFileTask *>(sender());
+    if (running_tasks_.contains(task)) {
+        running_tasks_[task].bytes = bytes;
+    }
 }
 
 void PostFilesTask::onPostTaskFinished(bool success)
 {
-    if (canceled_) {
+    PostFileTask *task = qobject_cast<PostFileTask *>(sender());
+    if (canceled_ || !running_tasks_.contains(task)) {
         return;
     }
+    RunningTask running = running_tasks_.take(task);
+    task->deleteLater();
 
     if (!success) {
-        error_ = task_->error();
-        error_string_ = task_->errorString();
-        http_error_code_ = task_->httpErrorCode();
+        // fail fast, the other uploads are useless now
+        error_ = task->error();
+        error_string_ = task->errorString();
+        http_error_code_ = task->httpErrorCode();
         progress_update_timer_->stop();
+        canceled_ = true;
+        cancelRunningTasks();
         emit finished(false);
         return;
     }
 
-    transferred_bytes_ += file_sizes[current_num_];
+    // the server has created all the folders of the file
+    Q_FOREACH(const QString& folder, foldersOf(relativePathOf(running.num)))
+    {
+        created_dirs_.insert(folder);
+    }
+    transferred_bytes_ += file_sizes[running.num];
+    finished_num_++;
     startNext();
 }
 
+QString PostFilesTask::relativePathOf(int num) const
+{
+    if (!use_relative_)
+        return QString();
+    return ::pathJoin(QFileInfo(local_path_).fileName(), ::getParentPath(names_[num]));
+}
+
+/**
+ * The server creates the folder of `relative_path`, and its missing
+ * ancestors, when receiving a file in it. To avoid racing on creating the
+ * same folder, a file is not uploaded while a running upload may still be
+ * creating one of its folders, e.g. "a/b" for the files of "a/b/c" and
+ * "a/b/d".
+ */
+bool PostFilesTask::canStart(int num) const
+{
+    QStringList missing;
+    Q_FOREACH(const QString& folder, foldersOf(relativePathOf(num)))
+    {
+        if (!created_dirs_.contains(folder)) {
+            missing.push_back(folder);
+        }
+    }
+    if (missing.isEmpty()) {
+        return true;
+    }
+    Q_FOREACH(const RunningTask& running, running_tasks_)
+    {
+        QStringList running_folders = foldersOf(relativePathOf(running.num));
+        Q_FOREACH(const QString& folder, missing)
+        {
+            if (running_folders.contains(folder)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 void PostFilesTask::startNext()
 {
-    progress_update_timer_->stop();
-    if (++current_num_ == names_.size()) {
+    if (finished_num_ == names_.size()) {
+        progress_update_timer_->stop();
         emit finished(true);
         return;
     }
-    const QString& file_path = names_[current_num_];
-    QString file_name = QFileInfo(file_path).fileName();
-    QString relative_path;
-    if (use_relative_)
-        relative_path = ::pathJoin(QFileInfo(local_path_).fileName(), ::getParentPath(file_path));
-
-    // relative_path might be empty, and should be safe to use as well
-    task_.reset(new PostFileTask(url_,
-        parent_dir_,
-        ::pathJoin(local_path_, file_path),
-        file_name,
-        relative_path));
-    connect(task_.data(), SIGNAL(progressUpdate(qint64, qint64)),
-            this, SLOT(onPostTaskProgressUpdate(qint64, qint64)));
-    connect(task_.data(), SIGNAL(finished(bool)),
-            this, SLOT(onPostTaskFinished(bool)));
-    current_bytes_ = 0;
-    progress_update_timer_->start(100);
-    task_->start();
+
+    while (!canceled_ &&
+           running_tasks_.size() < max_concurrent_ &&
+           next_num_ < names_.size() &&
+           canStart(next_num_)) {
+        int num = next_num_++;
+        const QString& file_path = names_[num];
+        QString file_name = QFileInfo(file_path).fileName();
+
+        // relative_path might be empty, and should be safe to use as well
+        PostFileTask *task = new PostFileTask(url_,
+            parent_dir_,
+            ::pathJoin(local_path_, file_path),
+            file_name,
+            relativePathOf(num));
+        connect(task, SIGNAL(progressUpdate(qint64, qint64)),
+                this, SLOT(onPostTaskProgressUpdate(qint64, qint64)));
+        connect(task, SIGNAL(finished(bool)),
+                this, SLOT(onPostTaskFinished(bool)));
+        RunningTask running;
+        running.num = num;
+        running.bytes = 0;
+        running_tasks_.insert(task, running);
+        // may fail (and cancel everything) immediately
+        task->start();
+    }
 }
 
 void FileServerTask::setError(FileNetworkTask::TaskError error,
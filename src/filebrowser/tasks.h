@@ -4,18 +4,21 @@
 #include <QObject>
 #include <QUrl>
 #include <QSharedPointer>
+#include <QHash>
+#include <QSet>
 
 #include "api/server-repo.h"
 #include "account.h"
 
-class QTemporaryFile;
 class QFile;
 class QNetworkAccessManager;
 class QNetworkReply;
 class QThread;
 class QSslError;
+class QHttpMultiPart;
 
 class FileServerTask;
+class MappedFileDevice;
 class SeafileApiRequest;
 class ApiError;
 
@@ -25,13 +28,16 @@ template<typename T> class QList;
  * Handles file upload/download using seafile web api.
  * The task contains two phases:
  *
- * First, we need to get the upload/download link for seahub.
+ * First, we need to get the upload/download link for seahub. Links which
+ * can be reused (see `linkCacheKey()`) are cached for a while, in which case
+ * this phase is skipped.
  * Second, we upload/download file to seafile fileserver with that link using
  * a `FileServerTask`.
  *
  *
- * In second phase, the FileServerTask is moved to a worker thread to execute,
- * since we will do blocking file IO in that task.
+ * In second phase, the FileServerTask is moved to one of the worker threads
+ * of `TransferWorkerPool` to execute, since we will do blocking file IO in
+ * that task.
  *
  * @abstract
  */
@@ -59,6 +65,7 @@ public:
 
     // accessors
     virtual TaskType type() const = 0;
+    const Account& account() const { return account_; }
     const QString& repoId() const { return repo_id_; };
     QString path() const { return path_; };
     QString localFilePath() const { return local_path_; }
@@ -108,6 +115,13 @@ protected slots:
 protected:
     virtual void createGetLinkRequest() = 0;
     virtual void createFileServerTask(const QString& link) = 0;
+    // The key under which the link of this task is cached, or an empty
+    // string if the link can't be shared with other tasks
+    virtual QString linkCacheKey() const { return QString(); }
+    // A cached link may be rejected by the server, the task is then run
+    // again with a new link. Only the tasks which can be run again without
+    // transferring twice what they have transferred may use cached links.
+    virtual bool canUseCachedLink() const { return true; }
 
     FileServerTask *fileserver_task_;
     SeafileApiRequest *get_link_req_;
@@ -122,14 +136,17 @@ protected:
     QString error_string_;
     int http_error_code_;
     bool canceled_;
+    bool link_from_cache_;
 
     Progress progress_;
 
-    static QThread *worker_thread_;
     // keep a copy of shared_ptr
     // for we can't get shared_ptr from weak_ptr
     QSharedPointer<FileNetworkTask> __shared_ptr;
     QWeakPointer<FileNetworkTask> __weak_ptr;
+
+private:
+    void sendGetLinkRequest();
 };
 
 
@@ -183,6 +200,7 @@ public:
 protected:
     void createFileServerTask(const QString& link);
     void createGetLinkRequest();
+    QString linkCacheKey() const;
 
     const QString name_;
 
@@ -207,6 +225,7 @@ public:
 
 protected:
     void createFileServerTask(const QString& link);
+    bool canUseCachedLink() const { return false; }
 
     const QStringList names_;
 };
@@ -222,6 +241,7 @@ public:
 
 protected:
     void createFileServerTask(const QString& link);
+    bool canUseCachedLink() const { return false; }
 };
 
 /**
@@ -274,11 +294,17 @@ protected:
      */
     virtual void sendRequest() = 0;
     virtual void onHttpRequestFinished() = 0;
+    /**
+     * Give the subclass a chance to recover from a 4xx/5xx response, or a
+     * network error (with `code` being 0), e.g. by resending the request.
+     * Return true if the error has been handled.
+     */
+    virtual bool handleHttpError(int code) { return false; }
     bool handleHttpRedirect();
     void setError(FileNetworkTask::TaskError error, const QString& error_string);
     void setHttpError(int code);
+    QNetworkAccessManager *networkManager() const;
 
-    static QNetworkAccessManager *network_mgr_;
     QUrl url_;
     QString local_path_;
     QString oid_;
@@ -292,24 +318,126 @@ protected:
     int http_error_code_;
 };
 
+/**
+ * Writes the blocks of a downloaded file in the disk io thread, so that slow
+ * disks never block the network io of the transfer worker thread.
+ *
+ * All member functions are invoked through queued connections, so they are
+ * executed in the order they are requested.
+ */
+class DownloadFileWriter : public QObject {
+    Q_OBJECT
+public:
+    // The writer takes the ownership of the (already opened) file
+    DownloadFileWriter(QFile *file, bool keep_partial_file);
+    ~DownloadFileWriter();
+
+    static QThread *diskIOThread();
+
+public slots:
+    void writeBlock(const QByteArray& block);
+    void truncate();
+    // Reserve disk space for the whole file without changing its size
+    void preallocate(qint64 size);
+    // Verify the size of the file against `expected_size` (skipped if
+    // unknown), then move it to its final location
+    void commit(const QString& local_path, qint64 expected_size);
+
+signals:
+    void blockWritten(qint64 bytes);
+    void writeFailed(const QString& error);
+    // `size` is the actual size of the file
+    void verificationFailed(const QString& reason, qint64 size);
+    void committed(bool success, const QString& error);
+
+private:
+    QFile *file_;
+    const bool keep_partial_file_;
+    bool failed_;
+};
+
+/**
+ * Download a file to `local_path`.
+ *
+ * The data is written to a partial file under the "fcachetmp" folder, which
+ * is named after (repo_id, path, file_id). If the download fails or is
+ * canceled, the partial file is kept, and the next download of the same
+ * file id continues from its end with a "Range" request.
+ *
+ * The reply is read in fixed size blocks, which are handed to a
+ * `DownloadFileWriter`. The read buffer of the reply is capped, and no more
+ * blocks are read while too many bytes are waiting to be written. So the
+ * memory used by a download is bounded no matter how large the file is.
+ *
+ * Before the file is moved to `local_path` it is verified: the "ETag" sent by
+ * the file server must be the expected file id, and the size must match the
+ * one announced by the response. A download cut short, e.g. a truncated 200
+ * response, is resumed from the end of the file a few times, and a file
+ * larger than announced is downloaded again from the beginning.
+ */
 class GetFileTask : public FileServerTask {
     Q_OBJECT
 public:
-    GetFileTask(const QUrl& url, const QString& local_path);
+    GetFileTask(const QUrl& url,
+                const QString& local_path,
+                const QString& repo_id = QString(),
+                const QString& path = QString(),
+                const QString& file_id = QString());
     ~GetFileTask();
 
 protected:
     void prepare();
     void sendRequest();
     void onHttpRequestFinished();
+    bool handleHttpError(int code);
 
 private slots:
     void httpReadyRead();
+    void onDownloadProgress(qint64 received, qint64 total);
+    void onBlockWritten(qint64 bytes);
+    void onWriteFailed(const QString& error);
+    void onVerificationFailed(const QString& reason, qint64 size);
+    void onCommitted(bool success, const QString& error);
 
 private:
-    QTemporaryFile *tmp_file_;
+    bool checkResponse();
+    bool checkResponseRange();
+    bool checkResponseETag();
+    void parseExpectedSize();
+    void restartDownload();
+    void readBlocks();
+    void commitIfDone();
+    bool resumable() const { return !file_id_.isEmpty(); }
+
+    const QString repo_id_;
+    const QString path_;
+    const QString file_id_;
+
+    DownloadFileWriter *writer_;
+    // the size of the file once all the blocks are written
+    qint64 file_size_;
+    // bytes handed to the writer but not written yet
+    qint64 pending_bytes_;
+    // the size of the partial file when the current request was sent
+    qint64 resume_offset_;
+    bool preallocated_;
+    bool reply_finished_;
+    bool committing_;
+    bool response_checked_;
+    // the size of the whole file announced by the response, -1 if unknown
+    qint64 expected_size_;
+    int verify_retries_;
 };
 
+/**
+ * Upload a file to the file server.
+ *
+ * In chunked mode the file is sent in ranges of kUploadChunkSize bytes, each
+ * with a "Content-Range" header, which is supported by seafile server 5.1.0
+ * and later. The offset acknowledged by the server is recorded, so a chunk
+ * which fails because of network errors is resent, and a later upload of
+ * the same file continues from that offset.
+ */
 class PostFileTask : public FileServerTask {
     Q_OBJECT
 public:
@@ -326,19 +454,43 @@ public:
                  const QString& relative_path);
     ~PostFileTask();
 
+    void setChunkedUpload(bool chunked) { chunked_ = chunked; }
+
 protected:
     void prepare();
     void sendRequest();
     void onHttpRequestFinished();
+    bool handleHttpError(int code);
+
+private slots:
+    void sendChunk();
+    void onChunkUploadProgress(qint64 sent, qint64 total);
 
 private:
+    void appendFormParams(QHttpMultiPart *multipart);
+    QString uploadKey() const;
+
     const QString parent_dir_;
-    QFile *file_;
+    MappedFileDevice *file_;
     const QString name_;
     const bool use_upload_;
     const QString relative_path_;
+
+    bool chunked_;
+    // the offset acknowledged by the server
+    qint64 chunk_offset_;
+    qint64 chunk_size_;
+    qint64 file_size_;
+    int chunk_retries_;
+    bool resumed_;
 };
 
+/**
+ * Upload multiple files with a window of at most `max_concurrent`
+ * `PostFileTask`s running at the same time.
+ *
+ * The first failed upload cancels all the others and fails the whole task.
+ */
 class PostFilesTask : public FileServerTask {
     Q_OBJECT
 public:
@@ -346,9 +498,9 @@ public:
                   const QString& parent_dir,
                   const QString& local_path,
                   const QStringList& names,
-                  const bool use_relative);
+                  const bool use_relative,
+                  int max_concurrent = 1);
     ~PostFilesTask();
-    int currentNum();
 
 protected:
     void prepare();
@@ -365,14 +517,14 @@ private:
     // never used
     void onHttpRequestFinished() {}
 
-    // deleter
-    template<typename T>
-    struct doDeleteLater
-    {
-        static inline void cleanup(T *pointer) {
-            if (pointer != NULL)
-                pointer->deleteLater();
-        }
+    QString relativePathOf(int num) const;
+    bool canStart(int num) const;
+    void cancelRunningTasks();
+
+    struct RunningTask {
+        int num;
+        // transferred bytes of this task
+        qint64 bytes;
     };
 
     const QString parent_dir_;
@@ -380,10 +532,13 @@ private:
     QList<qint64> file_sizes;
     const QStringList names_;
 
-    QScopedPointer<PostFileTask, doDeleteLater<PostFileTask> > task_;
-    int current_num_;
-    // transferred bytes in the current tasks
-    qint64 current_bytes_;
+    QHash<PostFileTask*, RunningTask> running_tasks_;
+    // the index of the next file to upload
+    int next_num_;
+    int finished_num_;
+    const int max_concurrent_;
+    // relative paths which are known to exist on the server
+    QSet<QString> created_dirs_;
     // the total bytes of completely transferred tasks
     qint64 transferred_bytes_;
     // the total bytes of all tasks
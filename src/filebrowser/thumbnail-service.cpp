@@ -0,0 +1,285 @@
+#include <limits>
+
+#include <QDir>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#if defined(Q_OS_WIN32)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "utils/utils.h"
+#include "seafile-applet.h"
+#include "configurator.h"
+#include "api/api-error.h"
+#include "file-browser-requests.h"
+
+#include "thumbnail-service.h"
+
+namespace {
+
+const char *kThumbnailsDirName = "thumbnails";
+
+const int kMaxConcurrentThumbnailRequests = 3;
+// the rows scrolled out of view are dropped from the queue
+const int kMaxQueuedThumbnails = 50;
+const int kMaxCachedThumbnails = 500;
+
+// after a transient failure, e.g. a timeout or a server error
+const qint64 kRetryFailedThumbnailMSecs = 60 * 1000;
+
+const qint64 kMaxThumbnailsDirBytes = 50 * 1024 * 1024;
+// trim the thumbnails folder after this many thumbnails are saved
+const int kTrimThumbnailsInterval = 20;
+
+// Update the modification time of the file to now
+void touchFile(const QString& path)
+{
+#if defined(Q_OS_WIN32)
+    _wutime((const wchar_t *)path.utf16(), NULL);
+#else
+    utime(QFile::encodeName(path).data(), NULL);
+#endif
+}
+
+} // namespace
+
+SINGLETON_IMPL(ThumbnailService)
+
+ThumbnailService::ThumbnailService()
+    : worker_thread_(NULL),
+      worker_(NULL)
+{
+    cache_.setMaxCost(kMaxCachedThumbnails);
+}
+
+ThumbnailService::~ThumbnailService()
+{
+    stop();
+}
+
+void ThumbnailService::start()
+{
+    QDir seafile_dir(seafApplet->configurator()->seafileDir());
+    if (!seafile_dir.mkpath(kThumbnailsDirName)) {
+        qWarning("failed to create thumbnails folder\n");
+        return;
+    }
+
+    worker_thread_ = new QThread;
+    worker_ = new ThumbnailWorker(seafile_dir.filePath(kThumbnailsDirName));
+    worker_->moveToThread(worker_thread_);
+    connect(worker_, SIGNAL(loaded(const QString&, const QImage&)),
+            this, SLOT(onThumbnailLoaded(const QString&, const QImage&)));
+    connect(worker_, SIGNAL(notCached(const QString&)),
+            this, SLOT(onThumbnailNotCached(const QString&)));
+    connect(worker_, SIGNAL(failed(const QString&)),
+            this, SLOT(onThumbnailFailed(const QString&)));
+    worker_thread_->start();
+}
+
+void ThumbnailService::stop()
+{
+    foreach (GetThumbnailRequest *req, reqs_.keys()) {
+        delete req;
+    }
+    reqs_.clear();
+    queue_.clear();
+    pending_.clear();
+
+    if (worker_thread_ == NULL)
+        return;
+
+    worker_thread_->quit();
+    worker_thread_->wait();
+    delete worker_;
+    worker_ = NULL;
+    delete worker_thread_;
+    worker_thread_ = NULL;
+}
+
+QPixmap ThumbnailService::getThumbnail(const Account& account,
+                                       const QString& repo_id,
+                                       const QString& path,
+                                       const QString& file_id,
+                                       int size)
+{
+    QString key = ::md5(account.serverUrl.host() + file_id + QString::number(size));
+    QPixmap *pixmap = cache_.object(key);
+    if (pixmap != NULL) {
+        return *pixmap;
+    }
+    if (worker_ == NULL) {
+        return QPixmap();
+    }
+    if (failed_.contains(key)) {
+        if (QDateTime::currentMSecsSinceEpoch() < failed_.value(key)) {
+            return QPixmap();
+        }
+        failed_.remove(key);
+    }
+
+    if (pending_.contains(key)) {
+        // it is in view again, fetch it before the others
+        if (queue_.removeOne(key)) {
+            queue_.prepend(key);
+        }
+        return QPixmap();
+    }
+
+    PendingThumbnail pending;
+    pending.account = account;
+    pending.repo_id = repo_id;
+    pending.path = path;
+    pending.file_id = file_id;
+    pending.size = size;
+    pending_[key] = pending;
+    QMetaObject::invokeMethod(worker_, "load", Q_ARG(QString, key));
+    return QPixmap();
+}
+
+void ThumbnailService::onThumbnailLoaded(const QString& key, const QImage& image)
+{
+    if (!pending_.contains(key)) {
+        return;
+    }
+    QString file_id = pending_.take(key).file_id;
+    cache_.insert(key, new QPixmap(QPixmap::fromImage(image)));
+    emit thumbnailReady(file_id);
+}
+
+void ThumbnailService::onThumbnailNotCached(const QString& key)
+{
+    if (!pending_.contains(key)) {
+        return;
+    }
+    queue_.prepend(key);
+    while (queue_.size() > kMaxQueuedThumbnails) {
+        // it is requested again if it comes into view again
+        pending_.remove(queue_.takeLast());
+    }
+    fetchNext();
+}
+
+void ThumbnailService::onThumbnailFailed(const QString& key)
+{
+    // the image can't be decoded
+    markFailed(key, true);
+}
+
+void ThumbnailService::markFailed(const QString& key, bool permanent)
+{
+    pending_.remove(key);
+    failed_[key] = permanent ? std::numeric_limits<qint64>::max()
+        : QDateTime::currentMSecsSinceEpoch() + kRetryFailedThumbnailMSecs;
+}
+
+void ThumbnailService::fetchNext()
+{
+    while (reqs_.size() < kMaxConcurrentThumbnailRequests && !queue_.isEmpty()) {
+        QString key = queue_.takeFirst();
+        const PendingThumbnail& pending = pending_[key];
+        GetThumbnailRequest *req = new GetThumbnailRequest(
+            pending.account, pending.repo_id, pending.path, pending.size);
+        connect(req, SIGNAL(success(const QByteArray&)),
+                this, SLOT(onGetThumbnailSuccess(const QByteArray&)));
+        connect(req, SIGNAL(failed(const ApiError&)),
+                this, SLOT(onGetThumbnailFailed(const ApiError&)));
+        reqs_[req] = key;
+        req->send();
+    }
+}
+
+void ThumbnailService::onGetThumbnailSuccess(const QByteArray& image_data)
+{
+    GetThumbnailRequest *req = qobject_cast<GetThumbnailRequest *>(sender());
+    if (req == NULL || !reqs_.contains(req)) {
+        return;
+    }
+    QString key = reqs_.take(req);
+    req->deleteLater();
+
+    QMetaObject::invokeMethod(worker_, "decode",
+                              Q_ARG(QString, key),
+                              Q_ARG(QByteArray, image_data),
+                              Q_ARG(int, pending_.value(key).size));
+    fetchNext();
+}
+
+void ThumbnailService::onGetThumbnailFailed(const ApiError& error)
+{
+    GetThumbnailRequest *req = qobject_cast<GetThumbnailRequest *>(sender());
+    if (req == NULL || !reqs_.contains(req)) {
+        return;
+    }
+    QString key = reqs_.take(req);
+    req->deleteLater();
+
+    // the server has no thumbnail for this file
+    int code = error.httpErrorCode();
+    markFailed(key, error.type() == ApiError::HTTP_ERROR && (code == 404 || code == 400));
+    fetchNext();
+}
+
+ThumbnailWorker::ThumbnailWorker(const QString& cache_dir)
+    : cache_dir_(cache_dir),
+      saved_since_trim_(0)
+{
+}
+
+QString ThumbnailWorker::thumbnailPath(const QString& key) const
+{
+    return QDir(cache_dir_).filePath(key + ".png");
+}
+
+void ThumbnailWorker::load(const QString& key)
+{
+    QString path = thumbnailPath(key);
+    QImage image(path);
+    if (image.isNull()) {
+        emit notCached(key);
+        return;
+    }
+    // for the LRU trimming
+    touchFile(path);
+    emit loaded(key, image);
+}
+
+void ThumbnailWorker::decode(const QString& key, const QByteArray& image_data, int size)
+{
+    QImage image;
+    if (!image.loadFromData(image_data)) {
+        qWarning("failed to decode thumbnail %s\n", toCStr(key));
+        emit failed(key);
+        return;
+    }
+    if (image.width() > size || image.height() > size) {
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    if (!image.save(thumbnailPath(key), "PNG")) {
+        qWarning("failed to save thumbnail %s\n", toCStr(key));
+    } else if (++saved_since_trim_ >= kTrimThumbnailsInterval) {
+        trimCache();
+    }
+    emit loaded(key, image);
+}
+
+void ThumbnailWorker::trimCache()
+{
+    saved_since_trim_ = 0;
+
+    // the most recently used first
+    QFileInfoList files = QDir(cache_dir_).entryInfoList(QDir::Files, QDir::Time);
+    qint64 total = 0;
+    foreach (const QFileInfo& info, files) {
+        total += info.size();
+        if (total > kMaxThumbnailsDirBytes) {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef SEAFILE_CLIENT_FILE_BROWSER_THUMBNAIL_SERVICE_H
+#define SEAFILE_CLIENT_FILE_BROWSER_THUMBNAIL_SERVICE_H
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QStringList>
+#include <QPixmap>
+#include <QImage>
+
+#include "utils/singleton.h"
+#include "account.h"
+
+class QThread;
+class ApiError;
+class GetThumbnailRequest;
+class ThumbnailWorker;
+
+/**
+ * Provide the thumbnails of the image files shown in the file browser.
+ *
+ * A thumbnail is looked up in memory first, then in the thumbnails folder
+ * on disk, and at last fetched from the server. At most a few thumbnails
+ * are fetched at the same time, and the latest requested ones go first,
+ * since they are the ones in view. The thumbnails are decoded, scaled and
+ * saved to (or loaded from) the disk by a ThumbnailWorker in its own
+ * thread, so scrolling is never blocked by them.
+ *
+ * The thumbnails are keyed by the file id, so they are still valid after
+ * the file is renamed or moved.
+ */
+class ThumbnailService : public QObject {
+    SINGLETON_DEFINE(ThumbnailService)
+    Q_OBJECT
+
+public:
+    void start();
+    void stop();
+
+    // Return a null pixmap if the thumbnail is not ready yet, and get it in
+    // the background. thumbnailReady is emitted once it is ready.
+    QPixmap getThumbnail(const Account& account,
+                         const QString& repo_id,
+                         const QString& path,
+                         const QString& file_id,
+                         int size);
+
+signals:
+    void thumbnailReady(const QString& file_id);
+
+private slots:
+    void onThumbnailLoaded(const QString& key, const QImage& image);
+    void onThumbnailNotCached(const QString& key);
+    void onThumbnailFailed(const QString& key);
+    void onGetThumbnailSuccess(const QByteArray& image_data);
+    void onGetThumbnailFailed(const ApiError& error);
+
+private:
+    ThumbnailService();
+    ~ThumbnailService();
+
+    struct PendingThumbnail {
+        Account account;
+        QString repo_id;
+        QString path;
+        QString file_id;
+        int size;
+    };
+
+    void fetchNext();
+    void markFailed(const QString& key, bool permanent);
+
+    QCache<QString, QPixmap> cache_;
+
+    // the thumbnails being loaded, queued or fetched, by key
+    QHash<QString, PendingThumbnail> pending_;
+    // the keys of the thumbnails to fetch from the server, latest first
+    QStringList queue_;
+    QHash<GetThumbnailRequest*, QString> reqs_;
+    // the thumbnails failed to get, and when to try again, in msecs since
+    // the epoch. Those not available from the server are not retried until
+    // restarted.
+    QHash<QString, qint64> failed_;
+
+    QThread *worker_thread_;
+    ThumbnailWorker *worker_;
+};
+
+/**
+ * Decode, scale and cache the thumbnails on disk, in its own thread.
+ *
+ * The thumbnails folder is kept within its budget by removing the least
+ * recently used thumbnails, the modification time of a thumbnail is updated
+ * each time it is used.
+ */
+class ThumbnailWorker : public QObject {
+    Q_OBJECT
+public:
+    ThumbnailWorker(const QString& cache_dir);
+
+public slots:
+    void load(const QString& key);
+    void decode(const QString& key, const QByteArray& image_data, int size);
+
+signals:
+    void loaded(const QString& key, const QImage& image);
+    void notCached(const QString& key);
+    void failed(const QString& key);
+
+private:
+    QString thumbnailPath(const QString& key) const;
+    void trimCache();
+
+    const QString cache_dir_;
+    int saved_since_trim_;
+};
+
+#endif // SEAFILE_CLIENT_FILE_BROWSER_THUMBNAIL_SERVICE_H
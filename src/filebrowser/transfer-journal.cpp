@@ -0,0 +1,160 @@
+#include <QDir>
+#include <sqlite3.h>
+
+#include "utils/utils.h"
+#include "configurator.h"
+#include "seafile-applet.h"
+
+#include "transfer-journal.h"
+
+namespace {
+
+const char *kTransferJournalDBName = "transfers.db";
+
+} // namespace
+
+SINGLETON_IMPL(TransferJournal)
+TransferJournal::TransferJournal()
+{
+    db_ = NULL;
+}
+
+TransferJournal::~TransferJournal()
+{
+    if (db_ != NULL)
+        sqlite3_close(db_);
+}
+
+void TransferJournal::start()
+{
+    const char *errmsg;
+    const char *sql;
+    sqlite3 *db;
+
+    QString db_path = QDir(seafApplet->configurator()->seafileDir()).filePath(kTransferJournalDBName);
+    if (sqlite3_open (toCStr(db_path), &db)) {
+        errmsg = sqlite3_errmsg (db);
+        qWarning("failed to open transfer journal database %s: %s",
+                 toCStr(db_path), errmsg ? errmsg : "no error given");
+        sqlite3_close(db);
+        // transfers still work without the journal, they are just not
+        // restored after a restart
+        return;
+    }
+
+    sql = "CREATE TABLE IF NOT EXISTS TransferJournal ("
+        "     type INTEGER NOT NULL, "
+        "     repo_id VARCHAR(36) NOT NULL, "
+        "     path VARCHAR(4096) NOT NULL, "
+        "     local_path VARCHAR(4096) NOT NULL, "
+        "     account_sig VARCHAR(40) NOT NULL, "
+        "     is_save_as INTEGER NOT NULL, "
+        "     state INTEGER NOT NULL, "
+        "     transferred INTEGER NOT NULL, "
+        "     total INTEGER NOT NULL, "
+        "     PRIMARY KEY (type, repo_id, path))";
+    sqlite_query_exec (db, sql);
+
+    char *zql = sqlite3_mprintf("DELETE FROM TransferJournal WHERE state = %d", Finished);
+    sqlite_query_exec (db, zql);
+    sqlite3_free(zql);
+
+    db_ = db;
+}
+
+void TransferJournal::saveTask(const Entry& entry)
+{
+    if (!db_) {
+        return;
+    }
+    char *zql = sqlite3_mprintf(
+        "REPLACE INTO TransferJournal VALUES (%d, %Q, %Q, %Q, %Q, %d, %d, %lld, %lld)",
+        entry.type, toCStr(entry.repo_id), toCStr(entry.path),
+        toCStr(entry.local_path), toCStr(entry.account_sig),
+        entry.is_save_as ? 1 : 0, entry.state,
+        entry.transferred, entry.total);
+    sqlite_query_exec (db_, zql);
+    sqlite3_free(zql);
+}
+
+void TransferJournal::setTaskState(TaskType type,
+                                   const QString& repo_id,
+                                   const QString& path,
+                                   TaskState state)
+{
+    if (!db_) {
+        return;
+    }
+    char *zql = sqlite3_mprintf(
+        "UPDATE TransferJournal SET state = %d"
+        "  WHERE type = %d AND repo_id = %Q AND path = %Q",
+        state, type, toCStr(repo_id), toCStr(path));
+    sqlite_query_exec (db_, zql);
+    sqlite3_free(zql);
+}
+
+void TransferJournal::setTaskProgress(TaskType type,
+                                      const QString& repo_id,
+                                      const QString& path,
+                                      qint64 transferred,
+                                      qint64 total)
+{
+    if (!db_) {
+        return;
+    }
+    char *zql = sqlite3_mprintf(
+        "UPDATE TransferJournal SET transferred = %lld, total = %lld"
+        "  WHERE type = %d AND repo_id = %Q AND path = %Q",
+        transferred, total, type, toCStr(repo_id), toCStr(path));
+    sqlite_query_exec (db_, zql);
+    sqlite3_free(zql);
+}
+
+void TransferJournal::removeTask(TaskType type,
+                                 const QString& repo_id,
+                                 const QString& path)
+{
+    if (!db_) {
+        return;
+    }
+    char *zql = sqlite3_mprintf(
+        "DELETE FROM TransferJournal WHERE type = %d AND repo_id = %Q AND path = %Q",
+        type, toCStr(repo_id), toCStr(path));
+    sqlite_query_exec (db_, zql);
+    sqlite3_free(zql);
+}
+
+bool TransferJournal::collectEntry(sqlite3_stmt *stmt, void *data)
+{
+    QList<Entry> *list = (QList<Entry> *)data;
+    Entry entry;
+    entry.type = (TaskType)sqlite3_column_int (stmt, 0);
+    entry.repo_id = (const char *)sqlite3_column_text (stmt, 1);
+    entry.path = QString::fromUtf8((const char *)sqlite3_column_text (stmt, 2));
+    entry.local_path = QString::fromUtf8((const char *)sqlite3_column_text (stmt, 3));
+    entry.account_sig = (const char *)sqlite3_column_text (stmt, 4);
+    entry.is_save_as = sqlite3_column_int (stmt, 5) != 0;
+    entry.state = (TaskState)sqlite3_column_int (stmt, 6);
+    entry.transferred = sqlite3_column_int64 (stmt, 7);
+    entry.total = sqlite3_column_int64 (stmt, 8);
+    list->append(entry);
+    return true;
+}
+
+QList<TransferJournal::Entry> TransferJournal::getUnfinishedTasks(TaskType type)
+{
+    QList<Entry> list;
+    if (!db_) {
+        return list;
+    }
+    char *zql = sqlite3_mprintf(
+        "SELECT type, repo_id, path, local_path, account_sig, is_save_as,"
+        "       state, transferred, total"
+        "  FROM TransferJournal"
+        "  WHERE type = %d AND state != %d"
+        "  ORDER BY rowid",
+        type, Finished);
+    sqlite_foreach_selected_row (db_, zql, collectEntry, &list);
+    sqlite3_free(zql);
+    return list;
+}
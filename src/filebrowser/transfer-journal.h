@@ -0,0 +1,79 @@
+#ifndef SEAFILE_CLIENT_FILE_BROWSER_TRANSFER_JOURNAL_H
+#define SEAFILE_CLIENT_FILE_BROWSER_TRANSFER_JOURNAL_H
+
+#include <QList>
+#include <QString>
+
+#include "utils/singleton.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+/**
+ * Record the download tasks of TransferManager and the upload tasks of
+ * AutoUpdateManager in "transfers.db", so the tasks which are queued or
+ * running when the applet quits (or crashes) can be started again the next
+ * time the applet starts.
+ *
+ * The schema is (type, repo_id, path, local_path, account_sig, is_save_as,
+ * state, transferred, total), with (type, repo_id, path) as the primary key.
+ * Finished tasks are removed when the journal is started.
+ */
+class TransferJournal {
+    SINGLETON_DEFINE(TransferJournal)
+public:
+    enum TaskType {
+        Download = 0,
+        Upload
+    };
+
+    enum TaskState {
+        Queued = 0,
+        Running,
+        Finished
+    };
+
+    struct Entry {
+        TaskType type;
+        QString repo_id;
+        QString path;
+        QString local_path;
+        QString account_sig;
+        bool is_save_as;
+        TaskState state;
+        qint64 transferred;
+        qint64 total;
+
+        Entry() : type(Download), is_save_as(false), state(Queued),
+                  transferred(0), total(0) {}
+    };
+
+    void start();
+
+    void saveTask(const Entry& entry);
+    void setTaskState(TaskType type,
+                      const QString& repo_id,
+                      const QString& path,
+                      TaskState state);
+    void setTaskProgress(TaskType type,
+                         const QString& repo_id,
+                         const QString& path,
+                         qint64 transferred,
+                         qint64 total);
+    void removeTask(TaskType type,
+                    const QString& repo_id,
+                    const QString& path);
+
+    // Return the queued and running tasks of the given type, in the order
+    // they were added
+    QList<Entry> getUnfinishedTasks(TaskType type);
+
+private:
+    TransferJournal();
+    ~TransferJournal();
+    static bool collectEntry(sqlite3_stmt *stmt, void *data);
+
+    sqlite3 *db_;
+};
+
+#endif // SEAFILE_CLIENT_FILE_BROWSER_TRANSFER_JOURNAL_H
@@ -5,22 +5,29 @@
 #include <QDateTime>
 #include <QTimer>
 #include <QDir>
+#include <QFileInfo>
 
 #include "utils/file-utils.h"
 #include "utils/utils.h"
 #include "configurator.h"
 #include "account-mgr.h"
 #include "seafile-applet.h"
+#include "settings-mgr.h"
 #include "file-browser-requests.h"
 #include "tasks.h"
 #include "auto-update-mgr.h"
 #include "data-cache.h"
 #include "data-mgr.h"
+#include "file-cache-mgr.h"
+#include "transfer-journal.h"
 
 #include "transfer-mgr.h"
 
 namespace {
 
+// Interval of saving the progress of running tasks to the journal
+const int kSaveProgressIntervalMSecs = 10 * 1000;
+
 bool isDownloadForGivenParentDir(const QSharedPointer<FileDownloadTask> &task,
                                  const QString& repo_id,
                                  const QString& parent_dir)
@@ -36,12 +43,25 @@ bool matchDownloadTask(const QSharedPointer<FileDownloadTask> &task,
     return task && task->repoId() == repo_id && task->path() == path;
 }
 
+// Tasks of different accounts on the same server share the per-server limit
+QString serverOfTask(const QSharedPointer<FileDownloadTask> &task)
+{
+    return task->account().serverUrl.host();
+}
+
 } // namespace
 
 SINGLETON_IMPL(TransferManager)
 
 TransferManager::TransferManager()
 {
+    SettingsManager *mgr = seafApplet->settingsManager();
+    max_running_ = mgr->maxConcurrentDownloads();
+    max_running_per_server_ = mgr->maxConcurrentDownloadsPerServer();
+
+    progress_timer_ = new QTimer(this);
+    connect(progress_timer_, SIGNAL(timeout()), this, SLOT(saveProgress()));
+    progress_timer_->start(kSaveProgressIntervalMSecs);
 }
 
 TransferManager::~TransferManager()
@@ -63,34 +83,153 @@ FileDownloadTask* TransferManager::addDownloadTask(const Account& account,
     QSharedPointer<FileDownloadTask> shared_task = task->sharedFromThis().objectCast<FileDownloadTask>();
     connect(task, SIGNAL(finished(bool)),
             this, SLOT(onDownloadTaskFinished(bool)));
-    if (current_download_) {
-        pending_downloads_.enqueue(shared_task);
-    } else {
-        startDownloadTask(shared_task);
-    }
+
+    TransferJournal::Entry entry;
+    entry.type = TransferJournal::Download;
+    entry.repo_id = repo_id;
+    entry.path = path;
+    entry.local_path = local_path;
+    entry.account_sig = account.getSignature();
+    entry.is_save_as = is_save_as_task;
+    TransferJournal::instance()->saveTask(entry);
+
+    pending_downloads_.enqueue(shared_task);
+    schedulePendingTasks();
     return task;
 }
 
+void TransferManager::restoreTasks()
+{
+    QList<TransferJournal::Entry> entries =
+        TransferJournal::instance()->getUnfinishedTasks(TransferJournal::Download);
+    foreach (const TransferJournal::Entry& entry, entries) {
+        Account account = seafApplet->accountManager()->getAccountBySignature(
+            entry.account_sig);
+        if (!account.isValid()) {
+            TransferJournal::instance()->removeTask(
+                TransferJournal::Download, entry.repo_id, entry.path);
+            continue;
+        }
+        qDebug("restore the download of %s (%lld/%lld bytes)\n",
+               toCStr(entry.path), entry.transferred, entry.total);
+        FileDownloadTask *task = addDownloadTask(account,
+                                                 entry.repo_id,
+                                                 entry.path,
+                                                 entry.local_path,
+                                                 entry.is_save_as);
+        // no DataManager is waiting for the files downloaded to the file cache
+        if (!entry.is_save_as) {
+            connect(task, SIGNAL(finished(bool)),
+                    this, SLOT(onRestoredCacheDownloadFinished(bool)));
+        }
+    }
+}
+
+void TransferManager::setMaxConcurrentDownloads(int max, int max_per_server)
+{
+    max_running_ = qMax(max, 1);
+    max_running_per_server_ = qMax(max_per_server, 1);
+    schedulePendingTasks();
+}
+
 void TransferManager::onDownloadTaskFinished(bool success)
 {
-    current_download_.clear();
-    if (!pending_downloads_.empty()) {
-        const QSharedPointer<FileDownloadTask> &task = pending_downloads_.dequeue();
+    FileDownloadTask *task = qobject_cast<FileDownloadTask *>(sender());
+    if (task == NULL)
+        return;
+    for (int i = 0; i < running_downloads_.size(); i++) {
+        if (running_downloads_[i].data() == task) {
+            running_downloads_.removeAt(i);
+            break;
+        }
+    }
+    if (success) {
+        TransferJournal::instance()->setTaskProgress(
+            TransferJournal::Download, task->repoId(), task->path(),
+            task->progress().total, task->progress().total);
+        TransferJournal::instance()->setTaskState(
+            TransferJournal::Download, task->repoId(), task->path(),
+            TransferJournal::Finished);
+    } else {
+        TransferJournal::instance()->removeTask(
+            TransferJournal::Download, task->repoId(), task->path());
+    }
+    schedulePendingTasks();
+}
+
+void TransferManager::onRestoredCacheDownloadFinished(bool success)
+{
+    FileDownloadTask *task = qobject_cast<FileDownloadTask *>(sender());
+    if (task == NULL || !success)
+        return;
+    QFileInfo file_info(task->localFilePath());
+    FileCacheDB::instance()->saveCachedFileId(task->repoId(),
+                                              task->path(),
+                                              task->fileId(),
+                                              task->account().getSignature(),
+                                              file_info.size(),
+                                              file_info.lastModified().toMSecsSinceEpoch());
+    AutoUpdateManager::instance()->watchCachedFile(
+        task->account(), task->repoId(), task->path());
+    FileCacheManager::instance()->checkQuotaLater();
+}
+
+void TransferManager::saveProgress()
+{
+    foreach (const QSharedPointer<FileDownloadTask>& task, running_downloads_) {
+        FileNetworkTask::Progress progress = task->progress();
+        TransferJournal::instance()->setTaskProgress(
+            TransferJournal::Download, task->repoId(), task->path(),
+            progress.transferred, progress.total);
+    }
+}
+
+int TransferManager::runningTasksForServer(const QString& server) const
+{
+    int count = 0;
+    foreach (const QSharedPointer<FileDownloadTask>& task, running_downloads_) {
+        if (serverOfTask(task) == server) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Start pending tasks in FIFO order, skipping over (but keeping the position
+ * of) the tasks whose server has already used up its slots.
+ */
+void TransferManager::schedulePendingTasks()
+{
+    int i = 0;
+    while (running_downloads_.size() < max_running_ &&
+           i < pending_downloads_.size()) {
+        const QString server = serverOfTask(pending_downloads_[i]);
+        if (runningTasksForServer(server) >= max_running_per_server_) {
+            i++;
+            continue;
+        }
+        QSharedPointer<FileDownloadTask> task = pending_downloads_.takeAt(i);
         startDownloadTask(task);
     }
 }
 
 void TransferManager::startDownloadTask(const QSharedPointer<FileDownloadTask> &task)
 {
-    current_download_ = task;
+    TransferJournal::instance()->setTaskState(
+        TransferJournal::Download, task->repoId(), task->path(),
+        TransferJournal::Running);
+    running_downloads_.append(task);
     task->start();
 }
 
 FileDownloadTask* TransferManager::getDownloadTask(const QString& repo_id,
                                                    const QString& path)
 {
-    if (matchDownloadTask(current_download_, repo_id, path)) {
-        return current_download_.data();
+    foreach (const QSharedPointer<FileDownloadTask>& task, running_downloads_) {
+        if (matchDownloadTask(task, repo_id, path)) {
+            return task.data();
+        }
     }
     foreach (const QSharedPointer<FileDownloadTask>& task, pending_downloads_) {
         if (matchDownloadTask(task, repo_id, path)) {
@@ -103,14 +242,20 @@ FileDownloadTask* TransferManager::getDownloadTask(const QString& repo_id,
 void TransferManager::cancelDownload(const QString& repo_id,
                                      const QString& path)
 {
-    FileDownloadTask* task = getDownloadTask(repo_id, path);
-    if (!task)
-        return;
-    QSharedPointer<FileDownloadTask> shared_task = task->sharedFromThis().objectCast<FileDownloadTask>();
-    if (task == current_download_) {
-        task->cancel();
-    } else {
-        pending_downloads_.removeOne(shared_task);
+    foreach (const QSharedPointer<FileDownloadTask>& task, running_downloads_) {
+        if (matchDownloadTask(task, repo_id, path)) {
+            // onDownloadTaskFinished removes it from the running list
+            task->cancel();
+            return;
+        }
+    }
+    for (int i = 0; i < pending_downloads_.size(); i++) {
+        if (matchDownloadTask(pending_downloads_[i], repo_id, path)) {
+            pending_downloads_.removeAt(i);
+            TransferJournal::instance()->removeTask(
+                TransferJournal::Download, repo_id, path);
+            return;
+        }
     }
 }
 
@@ -120,8 +265,10 @@ TransferManager::getDownloadTasks(const QString& repo_id,
                                   const QString& parent_dir)
 {
     QList<FileDownloadTask*> tasks;
-    if (isDownloadForGivenParentDir(current_download_, repo_id, parent_dir)) {
-        tasks.append(current_download_.data());
+    foreach (const QSharedPointer<FileDownloadTask>& task, running_downloads_) {
+        if (isDownloadForGivenParentDir(task, repo_id, parent_dir)) {
+            tasks.append(task.data());
+        }
     }
     foreach (const QSharedPointer<FileDownloadTask>& task, pending_downloads_) {
         if (isDownloadForGivenParentDir(task, repo_id, parent_dir)) {
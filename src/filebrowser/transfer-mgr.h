@@ -13,6 +13,7 @@
 template<typename Key> class QQueue;
 
 class QThread;
+class QTimer;
 
 class Account;
 class SeafileApiRequest;
@@ -26,9 +27,14 @@ class FileNetworkTask;
 /**
  * TransferManager manages all upload/download tasks.
  *
- * There is a pending tasks queue for all download tasks. At any moment only
- * one download task is running, others are waiting in the queue.
+ * There is a pending tasks queue for all download tasks. At any moment at
+ * most `max_running_` download tasks are running, and at most
+ * `max_running_per_server_` of them talk to the same server. Others are
+ * waiting in the queue and are started in FIFO order as soon as a slot
+ * (both global and per server) becomes available.
  *
+ * The queued and running tasks are recorded in the `TransferJournal`, and
+ * they are added again by `restoreTasks()` when the applet starts.
  */
 class TransferManager : public QObject {
     SINGLETON_DEFINE(TransferManager)
@@ -54,14 +60,34 @@ public:
     QList<FileDownloadTask*> getDownloadTasks(const QString& repo_id,
                                               const QString& parent_dir);
 
+    /**
+     * Change the concurrency limits. Pending tasks are started immediately
+     * if the new limits allow it.
+     */
+    void setMaxConcurrentDownloads(int max, int max_per_server);
+
+    /**
+     * Add the download tasks left unfinished by the last run of the applet
+     */
+    void restoreTasks();
+
 private slots:
     void onDownloadTaskFinished(bool success);
+    void onRestoredCacheDownloadFinished(bool success);
+    void saveProgress();
 
 private:
     void startDownloadTask(const QSharedPointer<FileDownloadTask> &task);
+    void schedulePendingTasks();
+    int runningTasksForServer(const QString& server) const;
 
-    QSharedPointer<FileDownloadTask> current_download_;
+    QList<QSharedPointer<FileDownloadTask> > running_downloads_;
     QQueue<QSharedPointer<FileDownloadTask> > pending_downloads_;
+
+    int max_running_;
+    int max_running_per_server_;
+
+    QTimer *progress_timer_;
 };
 
 
@@ -0,0 +1,83 @@
+#include <QThread>
+#include <QThreadStorage>
+#include <QNetworkAccessManager>
+
+#include "network-mgr.h"
+
+#include "transfer-worker-pool.h"
+
+namespace {
+
+const int kMinWorkerThreads = 2;
+const int kMaxWorkerThreads = 8;
+
+QThreadStorage<QNetworkAccessManager*> network_mgrs;
+
+} // namespace
+
+SINGLETON_IMPL(TransferWorkerPool)
+
+TransferWorkerPool::TransferWorkerPool()
+    : size_(qBound(kMinWorkerThreads, QThread::idealThreadCount(), kMaxWorkerThreads))
+{
+}
+
+TransferWorkerPool::~TransferWorkerPool()
+{
+}
+
+void TransferWorkerPool::assignTask(QObject *task)
+{
+    QThread *thread = leastLoadedThread();
+    loads_[thread]++;
+    TransferTaskLoad *load = new TransferTaskLoad(thread);
+    connect(task, SIGNAL(destroyed()), load, SLOT(onTaskDestroyed()));
+    task->moveToThread(thread);
+}
+
+QThread *TransferWorkerPool::leastLoadedThread()
+{
+    QThread *least = NULL;
+    Q_FOREACH(QThread *thread, threads_)
+    {
+        if (!least || loads_.value(thread) < loads_.value(least)) {
+            least = thread;
+        }
+    }
+
+    if (!least || (loads_.value(least) > 0 && threads_.size() < size_)) {
+        least = new QThread;
+        least->start();
+        threads_.append(least);
+        loads_[least] = 0;
+    }
+    return least;
+}
+
+void TransferWorkerPool::releaseThread(QThread *thread)
+{
+    loads_[thread]--;
+}
+
+void TransferWorkerPool::watchNetworkManager(QObject *manager)
+{
+    NetworkManager::instance()->addWatch(qobject_cast<QNetworkAccessManager*>(manager));
+}
+
+QNetworkAccessManager *TransferWorkerPool::networkManager()
+{
+    if (!network_mgrs.hasLocalData()) {
+        QNetworkAccessManager *manager = new QNetworkAccessManager;
+        network_mgrs.setLocalData(manager);
+        // NetworkManager is used in the main thread only
+        QMetaObject::invokeMethod(TransferWorkerPool::instance(), "watchNetworkManager",
+                                  Qt::QueuedConnection, Q_ARG(QObject*, manager));
+    }
+    return network_mgrs.localData();
+}
+
+void TransferTaskLoad::onTaskDestroyed()
+{
+    TransferWorkerPool::instance()->releaseThread(thread_);
+    deleteLater();
+}
@@ -0,0 +1,75 @@
+#ifndef SEAFILE_CLIENT_FILE_BROWSER_TRANSFER_WORKER_POOL_H
+#define SEAFILE_CLIENT_FILE_BROWSER_TRANSFER_WORKER_POOL_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+
+#include "utils/singleton.h"
+
+class QThread;
+class QNetworkAccessManager;
+
+/**
+ * A pool of worker threads to run the `FileServerTask`s in.
+ *
+ * Each task is moved to the worker thread with the least running tasks.
+ * New worker threads are started on demand until the pool reaches its size.
+ *
+ * Every worker thread has its own QNetworkAccessManager, which is created
+ * in that thread and must only be used by the tasks running in it.
+ */
+class TransferWorkerPool : public QObject {
+    SINGLETON_DEFINE(TransferWorkerPool)
+    Q_OBJECT
+public:
+    /**
+     * Move the task to the least loaded worker thread. The load of the
+     * thread is decreased when the task is destroyed.
+     */
+    void assignTask(QObject *task);
+
+    /**
+     * Return the network access manager of the current worker thread
+     */
+    static QNetworkAccessManager *networkManager();
+
+private slots:
+    void watchNetworkManager(QObject *manager);
+
+private:
+    friend class TransferTaskLoad;
+    TransferWorkerPool();
+    ~TransferWorkerPool();
+
+    QThread *leastLoadedThread();
+    void releaseThread(QThread *thread);
+
+    const int size_;
+    QList<QThread*> threads_;
+    // number of tasks running in each thread
+    QHash<QThread*, int> loads_;
+};
+
+/**
+ * The load a task puts on its worker thread, released when the task is
+ * destroyed.
+ *
+ * It lives in the main thread, while the task is destroyed in the worker
+ * thread, so it is notified through a queued connection. It can't be
+ * told apart by the address of the task, which may be reused by a new task
+ * before the notification arrives.
+ */
+class TransferTaskLoad : public QObject {
+    Q_OBJECT
+public:
+    TransferTaskLoad(QThread *thread) : thread_(thread) {}
+
+private slots:
+    void onTaskDestroyed();
+
+private:
+    QThread *const thread_;
+};
+
+#endif // SEAFILE_CLIENT_FILE_BROWSER_TRANSFER_WORKER_POOL_H
@@ -17,6 +17,7 @@
 #include "rpc/rpc-client.h"
 
 #include "filebrowser/file-browser-manager.h"
+#include "filebrowser/data-cache.h"
 
 #include "repo-service.h"
 #include "repo-service-helper.h"
@@ -226,6 +227,7 @@ void RepoService::refresh()
     }
 
     list_repo_req_ = new ListReposRequest(*account);
+    list_repo_account_sig_ = account->getSignature();
 
     connect(list_repo_req_, SIGNAL(success(const std::vector<ServerRepo>&)),
             this, SLOT(onRefreshSuccess(const std::vector<ServerRepo>&)));
@@ -241,6 +243,16 @@ void RepoService::onRefreshSuccess(const std::vector<ServerRepo>& repos)
 
     server_repos_ = repos;
 
+    // forget the stored dirents of the libraries removed or unshared
+    QStringList repo_ids;
+    for (size_t i = 0; i < repos.size(); i++) {
+        repo_ids.push_back(repos[i].id);
+    }
+    for (size_t i = 0; i < synced_subfolders_.size(); i++) {
+        repo_ids.push_back(synced_subfolders_[i].repoId());
+    }
+    DirentsCacheDB::instance()->removeOtherRepos(list_repo_account_sig_, repo_ids);
+
     // if we have local repo missed in server_repos
     // start a GetRepoRequest for it
     for (size_t i = 0; i < synced_subfolders_.size(); ++i) {
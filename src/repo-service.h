@@ -80,6 +80,8 @@ private:
 
     QTimer *refresh_timer_;
     bool in_refresh_;
+    // the signature of the account whose libraries are being listed
+    QString list_repo_account_sig_;
 };
 
 #endif // SEAFILE_CLIENT_REPO_SERVICE_H_
@@ -36,6 +36,10 @@
 #include "seahub-notifications-monitor.h"
 #include "filebrowser/data-cache.h"
 #include "filebrowser/auto-update-mgr.h"
+#include "filebrowser/file-cache-mgr.h"
+#include "filebrowser/thumbnail-service.h"
+#include "filebrowser/transfer-mgr.h"
+#include "filebrowser/transfer-journal.h"
 #include "rpc/local-repo.h"
 #include "server-status-service.h"
 
@@ -308,9 +312,14 @@ void SeafileApplet::onDaemonStarted()
     // start network-related services
     //
     FileCacheDB::instance()->start();
+    DirentsCacheDB::instance()->start();
+    TransferJournal::instance()->start();
     AutoUpdateManager::instance()->start();
+    FileCacheManager::instance()->start();
+    TransferManager::instance()->restoreTasks();
 
     AvatarService::instance()->start();
+    ThumbnailService::instance()->start();
 
     SeahubNotificationsMonitor::instance()->start();
     ServerStatusService::instance()->start();
@@ -385,6 +394,9 @@ void SeafileApplet::onAboutToQuit()
     if (main_win_) {
         main_win_->writeSettings();
     }
+    FileCacheDB::instance()->stop();
+    DirentsCacheDB::instance()->stop();
+    ThumbnailService::instance()->stop();
 }
 // stop the main event loop and return to the main function
 void SeafileApplet::errorAndExit(const QString& error)
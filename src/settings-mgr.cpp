@@ -31,6 +31,17 @@ const char *kBehaviorGroup = "Behavior";
 
 const char *kSettingsGroup = "Settings";
 const char *kComputerName = "computerName";
+const char *kMaxConcurrentDownloads = "maxConcurrentDownloads";
+const char *kMaxConcurrentDownloadsPerServer = "maxConcurrentDownloadsPerServer";
+const char *kMaxConcurrentFileUploads = "maxConcurrentFileUploads";
+const char *kDirentsCacheSizeMB = "direntsCacheSizeMB";
+const char *kFileCacheQuotaMB = "fileCacheQuotaMB";
+
+const int kDefaultMaxConcurrentDownloads = 4;
+const int kDefaultMaxConcurrentDownloadsPerServer = 2;
+const int kDefaultMaxConcurrentFileUploads = 4;
+const int kDefaultDirentsCacheSizeMB = 32;
+const int kDefaultFileCacheQuotaMB = 2048;
 #ifdef HAVE_FINDER_SYNC_SUPPORT
 const char *kFinderSync = "finderSync";
 #endif // HAVE_FINDER_SYNC_SUPPORT
@@ -467,6 +478,111 @@ void SettingsManager::setComputerName(const QString& computerName)
     settings.endGroup();
 }
 
+int SettingsManager::maxConcurrentDownloads()
+{
+    QSettings settings;
+    int max;
+
+    settings.beginGroup(kSettingsGroup);
+    max = settings.value(kMaxConcurrentDownloads,
+                         kDefaultMaxConcurrentDownloads).toInt();
+    settings.endGroup();
+
+    return qMax(max, 1);
+}
+
+void SettingsManager::setMaxConcurrentDownloads(int max)
+{
+    QSettings settings;
+    settings.beginGroup(kSettingsGroup);
+    settings.setValue(kMaxConcurrentDownloads, max);
+    settings.endGroup();
+}
+
+int SettingsManager::maxConcurrentDownloadsPerServer()
+{
+    QSettings settings;
+    int max;
+
+    settings.beginGroup(kSettingsGroup);
+    max = settings.value(kMaxConcurrentDownloadsPerServer,
+                         kDefaultMaxConcurrentDownloadsPerServer).toInt();
+    settings.endGroup();
+
+    return qMax(max, 1);
+}
+
+void SettingsManager::setMaxConcurrentDownloadsPerServer(int max)
+{
+    QSettings settings;
+    settings.beginGroup(kSettingsGroup);
+    settings.setValue(kMaxConcurrentDownloadsPerServer, max);
+    settings.endGroup();
+}
+
+int SettingsManager::maxConcurrentFileUploads()
+{
+    QSettings settings;
+    int max;
+
+    settings.beginGroup(kSettingsGroup);
+    max = settings.value(kMaxConcurrentFileUploads,
+                         kDefaultMaxConcurrentFileUploads).toInt();
+    settings.endGroup();
+
+    return qMax(max, 1);
+}
+
+void SettingsManager::setMaxConcurrentFileUploads(int max)
+{
+    QSettings settings;
+    settings.beginGroup(kSettingsGroup);
+    settings.setValue(kMaxConcurrentFileUploads, max);
+    settings.endGroup();
+}
+
+int SettingsManager::direntsCacheSizeMB()
+{
+    QSettings settings;
+    int size;
+
+    settings.beginGroup(kSettingsGroup);
+    size = settings.value(kDirentsCacheSizeMB,
+                          kDefaultDirentsCacheSizeMB).toInt();
+    settings.endGroup();
+
+    return qMax(size, 1);
+}
+
+void SettingsManager::setDirentsCacheSizeMB(int size)
+{
+    QSettings settings;
+    settings.beginGroup(kSettingsGroup);
+    settings.setValue(kDirentsCacheSizeMB, size);
+    settings.endGroup();
+}
+
+int SettingsManager::fileCacheQuotaMB()
+{
+    QSettings settings;
+    int quota;
+
+    settings.beginGroup(kSettingsGroup);
+    quota = settings.value(kFileCacheQuotaMB,
+                           kDefaultFileCacheQuotaMB).toInt();
+    settings.endGroup();
+
+    return qMax(quota, 1);
+}
+
+void SettingsManager::setFileCacheQuotaMB(int quota)
+{
+    QSettings settings;
+    settings.beginGroup(kSettingsGroup);
+    settings.setValue(kFileCacheQuotaMB, quota);
+    settings.endGroup();
+}
+
 #ifdef HAVE_SHIBBOLETH_SUPPORT
 QString SettingsManager::getLastShibUrl()
 {
@@ -68,6 +68,24 @@ public:
     QString getComputerName();
     void setComputerName(const QString& computerName);
 
+    // limits of concurrently running file browser downloads
+    int maxConcurrentDownloads();
+    void setMaxConcurrentDownloads(int max);
+    int maxConcurrentDownloadsPerServer();
+    void setMaxConcurrentDownloadsPerServer(int max);
+
+    // limit of concurrently uploaded files in a multi-file/folder upload
+    int maxConcurrentFileUploads();
+    void setMaxConcurrentFileUploads(int max);
+
+    // memory budget (in MB) of the dirents cache of the file browser
+    int direntsCacheSizeMB();
+    void setDirentsCacheSizeMB(int size);
+
+    // disk quota (in MB) of the files downloaded by the file browser
+    int fileCacheQuotaMB();
+    void setFileCacheQuotaMB(int quota);
+
 #ifdef HAVE_SHIBBOLETH_SUPPORT
     QString getLastShibUrl();
     void setLastShibUrl(const QString& url);
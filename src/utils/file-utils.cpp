@@ -2,6 +2,17 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QStringList>
+#include <QFile>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#elif defined(Q_OS_MAC)
+#include <sys/attr.h>
+#include <sys/clonefile.h>
+#endif
 
 #include "file-utils.h"
 
@@ -735,3 +746,32 @@ QString getBaseName(const QString& path)
     }
     return p.mid(pos + 1);
 }
+
+bool cloneFile(const QString& src, const QString& dst)
+{
+    QByteArray src_path = QFile::encodeName(src);
+    QByteArray dst_path = QFile::encodeName(dst);
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    int src_fd = open(src_path.data(), O_RDONLY);
+    if (src_fd >= 0) {
+        int dst_fd = open(dst_path.data(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (dst_fd >= 0) {
+            bool cloned = ioctl(dst_fd, FICLONE, src_fd) == 0;
+            close(dst_fd);
+            close(src_fd);
+            if (cloned) {
+                return true;
+            }
+            // not supported by the file system, fall back to a plain copy
+            QFile::remove(dst);
+        } else {
+            close(src_fd);
+        }
+    }
+#elif defined(Q_OS_MAC) && defined(CLONE_NOFOLLOW)
+    if (clonefile(src_path.data(), dst_path.data(), CLONE_NOFOLLOW) == 0) {
+        return true;
+    }
+#endif
+    return QFile::copy(src, dst);
+}
@@ -18,5 +18,10 @@ QString pathJoin(const QString& a, const QStringList& rest);
 
 bool createDirIfNotExists(const QString& path);
 
+// Copy the file `src` to `dst`, sharing the data blocks of the two files
+// (a reflink) when the file system supports it. The two files are still
+// independent, writing to one of them does not change the other.
+bool cloneFile(const QString& src, const QString& dst);
+
 
 #endif // SEAFILE_CLIENT_FILE_UTILS_H_
@@ -0,0 +1,146 @@
+#include <cstring>
+
+#include "mapped-file-device.h"
+
+namespace {
+
+// Must be a multiple of the page size, and of the allocation granularity
+// (64KB) on windows
+const qint64 kMapAlignment = 64 * 1024;
+const qint64 kMapWindowSize = 32 * 1024 * 1024;
+// Files smaller than this are not worth mapping
+const qint64 kMinMappedFileSize = 1024 * 1024;
+const qint64 kReadBufferSize = 1024 * 1024;
+
+} // namespace
+
+MappedFileDevice::MappedFileDevice(const QString& path, QObject *parent)
+    : QIODevice(parent),
+      file_(path),
+      size_(0),
+      map_enabled_(true),
+      use_map_(false),
+      window_(NULL),
+      window_offset_(0),
+      window_size_(0),
+      buffer_offset_(0)
+{
+}
+
+MappedFileDevice::~MappedFileDevice()
+{
+    close();
+}
+
+bool MappedFileDevice::open(OpenMode mode)
+{
+    if ((mode & ReadWrite) != ReadOnly) {
+        qWarning("MappedFileDevice only supports read-only mode");
+        return false;
+    }
+    if (!file_.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        return false;
+    }
+    size_ = file_.size();
+    use_map_ = map_enabled_ && size_ >= kMinMappedFileSize;
+    buffer_.clear();
+    buffer_offset_ = 0;
+    // we do the buffering ourselves
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void MappedFileDevice::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    unmapWindow();
+    buffer_.clear();
+    file_.close();
+    QIODevice::close();
+}
+
+bool MappedFileDevice::mapWindow(qint64 pos)
+{
+    unmapWindow();
+    window_offset_ = pos - pos % kMapAlignment;
+    window_size_ = qMin(kMapWindowSize, size_ - window_offset_);
+    window_ = file_.map(window_offset_, window_size_);
+    return window_ != NULL;
+}
+
+void MappedFileDevice::unmapWindow()
+{
+    if (window_) {
+        file_.unmap(window_);
+        window_ = NULL;
+    }
+}
+
+qint64 MappedFileDevice::readData(char *data, qint64 maxlen)
+{
+    qint64 p = pos();
+    if (p >= size_) {
+        return 0;
+    }
+    qint64 len = qMin(maxlen, size_ - p);
+
+    if (use_map_ && file_.size() < size_) {
+        qWarning("%s has been truncated, stop mapping it",
+                 file_.fileName().toUtf8().data());
+        unmapWindow();
+        use_map_ = false;
+    }
+
+    if (use_map_) {
+        if (!window_ || p < window_offset_ || p >= window_offset_ + window_size_) {
+            if (!mapWindow(p)) {
+                qWarning("failed to map %s, fall back to reading it",
+                         file_.fileName().toUtf8().data());
+                use_map_ = false;
+            }
+        }
+        if (use_map_) {
+            len = qMin(len, window_offset_ + window_size_ - p);
+            memcpy(data, window_ + (p - window_offset_), len);
+            return len;
+        }
+    }
+
+    return readBuffered(data, p, len);
+}
+
+/**
+ * Serve the data from a buffer filled by reads of kReadBufferSize bytes at
+ * aligned offsets, so small reads of the caller don't become syscalls.
+ */
+qint64 MappedFileDevice::readBuffered(char *data, qint64 pos, qint64 len)
+{
+    if (pos < buffer_offset_ || pos >= buffer_offset_ + buffer_.size()) {
+        buffer_offset_ = pos - pos % kMapAlignment;
+        buffer_.resize(kReadBufferSize);
+        if (!file_.seek(buffer_offset_)) {
+            buffer_.clear();
+            return -1;
+        }
+        qint64 n = file_.read(buffer_.data(), kReadBufferSize);
+        if (n <= 0) {
+            buffer_.clear();
+            return n;
+        }
+        buffer_.resize(n);
+    }
+    if (pos >= buffer_offset_ + buffer_.size()) {
+        // the file has been truncated
+        return 0;
+    }
+
+    len = qMin(len, buffer_offset_ + buffer_.size() - pos);
+    memcpy(data, buffer_.constData() + (pos - buffer_offset_), len);
+    return len;
+}
+
+qint64 MappedFileDevice::writeData(const char * /* data */, qint64 /* len */)
+{
+    return -1;
+}
@@ -0,0 +1,65 @@
+#ifndef SEAFILE_CLIENT_UTILS_MAPPED_FILE_DEVICE_H_
+#define SEAFILE_CLIENT_UTILS_MAPPED_FILE_DEVICE_H_
+
+#include <QIODevice>
+#include <QFile>
+#include <QByteArray>
+
+/**
+ * A read-only device which serves the content of a file from a memory
+ * mapping of it, e.g. as the body device of an upload.
+ *
+ * The file is mapped in windows of kMapWindowSize bytes, so the address space
+ * used is bounded for any file size. Reading from the device is a memcpy
+ * from the mapping instead of a read() syscall plus the copies of QFile's
+ * buffering.
+ *
+ * Small files, and files which fail to be mapped, are read with large
+ * aligned reads into an internal buffer instead.
+ *
+ * The size of the file is checked before each read from the mapping, and
+ * the file is read instead once it has been truncated, since touching the
+ * mapping past its end would crash (SIGBUS). That can't rule out a file
+ * truncated during the read itself, so the mapping should be disabled for
+ * files which may be modified meanwhile, e.g. the ones open in an editor.
+ */
+class MappedFileDevice : public QIODevice {
+public:
+    explicit MappedFileDevice(const QString& path, QObject *parent = 0);
+    ~MappedFileDevice();
+
+    bool exists() const { return file_.exists(); }
+    bool isMapped() const { return use_map_; }
+    // Must be called before open()
+    void setMapEnabled(bool enabled) { map_enabled_ = enabled; }
+
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const { return false; }
+    qint64 size() const { return size_; }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen);
+    qint64 writeData(const char *data, qint64 len);
+
+private:
+    Q_DISABLE_COPY(MappedFileDevice)
+
+    bool mapWindow(qint64 pos);
+    void unmapWindow();
+    qint64 readBuffered(char *data, qint64 pos, qint64 len);
+
+    QFile file_;
+    qint64 size_;
+    bool map_enabled_;
+    bool use_map_;
+
+    uchar *window_;
+    qint64 window_offset_;
+    qint64 window_size_;
+
+    QByteArray buffer_;
+    qint64 buffer_offset_;
+};
+
+#endif // SEAFILE_CLIENT_UTILS_MAPPED_FILE_DEVICE_H_
@@ -0,0 +1,112 @@
+#include "test_api-request-scheduler.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtTest/QtTest>
+
+namespace {
+
+// the slots a user initiated request may use, which don't age
+const int kUserInitiatedSlots = 4;
+const int kTimeoutMSecs = 5000;
+// long enough for a request which could be started to reach the server
+const int kSettleMSecs = 500;
+
+// Run the event loop until the server has received `count` requests, or
+// for `msecs` at most
+void waitForRequests(const SilentServer& server, int count, int msecs)
+{
+    QTime started;
+    started.start();
+    while (server.requests() < count && started.elapsed() < msecs) {
+        QEventLoop loop;
+        QTimer::singleShot(20, &loop, SLOT(quit()));
+        loop.exec();
+    }
+}
+
+// Send `count` requests to different urls, so they are not coalesced
+QList<HangingRequest *> sendRequests(const SilentServer& server, int count)
+{
+    QList<HangingRequest *> reqs;
+    for (int i = 0; i < count; i++) {
+        HangingRequest *req = new HangingRequest(
+            QUrl(QString("http://127.0.0.1:%1/hang/%2/").arg(server.port()).arg(i)));
+        req->setPriority(SeafileApiRequest::PRIORITY_USER_INITIATED);
+        req->send();
+        reqs.push_back(req);
+    }
+    return reqs;
+}
+
+} // namespace
+
+bool SilentServer::listen()
+{
+    connect(&server_, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    return server_.listen(QHostAddress::LocalHost);
+}
+
+void SilentServer::onNewConnection()
+{
+    while (server_.hasPendingConnections()) {
+        QTcpSocket *socket = server_.nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void SilentServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+    // a GET has no body, it ends with its headers
+    while (request.contains("\r\n\r\n")) {
+        request = request.mid(request.indexOf("\r\n\r\n") + 4);
+        requests_++;
+    }
+    socket->setProperty("request", request);
+}
+
+void ApiRequestSchedulerTest::testDeleteRunningRequest() {
+    SilentServer server;
+    QVERIFY(server.listen());
+
+    QList<HangingRequest *> reqs = sendRequests(server, kUserInitiatedSlots + 1);
+    waitForRequests(server, kUserInitiatedSlots + 1, kSettleMSecs);
+    QVERIFY(server.requests() == kUserInitiatedSlots);
+
+    // the slot of the deleted request goes to the queued one
+    delete reqs.takeFirst();
+    waitForRequests(server, kUserInitiatedSlots + 1, kTimeoutMSecs);
+    QVERIFY(server.requests() == kUserInitiatedSlots + 1);
+
+    qDeleteAll(reqs);
+}
+
+void ApiRequestSchedulerTest::testDeleteQueuedRequest() {
+    SilentServer server;
+    QVERIFY(server.listen());
+
+    QList<HangingRequest *> reqs = sendRequests(server, kUserInitiatedSlots + 2);
+    waitForRequests(server, kUserInitiatedSlots, kTimeoutMSecs);
+    QVERIFY(server.requests() == kUserInitiatedSlots);
+
+    // the deleted request is dropped from the queue, and only the other one
+    // takes the slot given up next
+    delete reqs.takeLast();
+    delete reqs.takeFirst();
+    waitForRequests(server, kUserInitiatedSlots + 2, kSettleMSecs);
+    QVERIFY(server.requests() == kUserInitiatedSlots + 1);
+
+    qDeleteAll(reqs);
+}
+
+// the requests only need an event loop, not a QApplication
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    ApiRequestSchedulerTest test;
+    return QTest::qExec(&test, argc, argv);
+}
@@ -0,0 +1,50 @@
+#ifndef TESTS_API_REQUEST_SCHEDULER_H
+#define TESTS_API_REQUEST_SCHEDULER_H
+#include <QObject>
+#include <QTcpServer>
+
+#include "../src/api/api-request.h"
+
+/**
+ * A server which accepts the requests but never answers them, so the
+ * requests sent to it never signal
+ */
+class SilentServer : public QObject {
+    Q_OBJECT
+public:
+    SilentServer() : requests_(0) {}
+
+    bool listen();
+    quint16 port() const { return server_.serverPort(); }
+    // The number of requests received so far
+    int requests() const { return requests_; }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    QTcpServer server_;
+    int requests_;
+};
+
+class HangingRequest : public SeafileApiRequest {
+    Q_OBJECT
+public:
+    HangingRequest(const QUrl& url) : SeafileApiRequest(url, METHOD_GET) {}
+
+protected slots:
+    void requestSuccess(QNetworkReply& /* reply */) {}
+};
+
+class ApiRequestSchedulerTest : public QObject {
+    Q_OBJECT
+public:
+    virtual ~ApiRequestSchedulerTest() {};
+
+private slots:
+    void testDeleteRunningRequest();
+    void testDeleteQueuedRequest();
+};
+
+#endif // TESTS_API_REQUEST_SCHEDULER_H
@@ -0,0 +1,62 @@
+#include "test_api-retry.h"
+#include <QtTest/QtTest>
+
+#include "../src/api/api-retry.h"
+
+namespace {
+
+QDateTime now()
+{
+    return QDateTime(QDate(2015, 10, 21), QTime(7, 28, 0), Qt::UTC);
+}
+
+} // namespace
+
+void ApiRetryTest::testRetryAfterSeconds() {
+    QVERIFY(parseRetryAfter("0", now()) == 0);
+    QVERIFY(parseRetryAfter("120", now()) == 120 * 1000);
+    QVERIFY(parseRetryAfter(" 5 ", now()) == 5000);
+}
+
+void ApiRetryTest::testRetryAfterDate() {
+    QVERIFY(parseRetryAfter("Wed, 21 Oct 2015 07:28:00 GMT", now()) == 0);
+    QVERIFY(parseRetryAfter("Wed, 21 Oct 2015 07:29:30 GMT", now()) == 90 * 1000);
+}
+
+void ApiRetryTest::testRetryAfterPastDate() {
+    QVERIFY(parseRetryAfter("Tue, 20 Oct 2015 07:28:00 GMT", now()) == 0);
+    QVERIFY(parseRetryAfter("-10", now()) == 0);
+}
+
+void ApiRetryTest::testRetryAfterCap() {
+    QVERIFY(parseRetryAfter("300", now()) == kMaxRetryAfterMsecs);
+    QVERIFY(parseRetryAfter("301", now()) == kMaxRetryAfterMsecs + 1);
+    QVERIFY(parseRetryAfter("99999999999", now()) == kMaxRetryAfterMsecs + 1);
+    QVERIFY(parseRetryAfter("Thu, 22 Oct 2015 07:28:00 GMT", now()) == kMaxRetryAfterMsecs + 1);
+}
+
+void ApiRetryTest::testRetryAfterInvalid() {
+    QVERIFY(parseRetryAfter("", now()) == -1);
+    QVERIFY(parseRetryAfter("soon", now()) == -1);
+    QVERIFY(parseRetryAfter("21 Oct 2015", now()) == -1);
+}
+
+void ApiRetryTest::testBackoffDelay() {
+    for (int retries = 0; retries < 10; retries++) {
+        int max_delay = qMin(kRetryBaseDelayMsecs << qMin(retries, 5), kRetryMaxDelayMsecs);
+        for (int i = 0; i < 100; i++) {
+            int delay = retryBackoffDelay(retries);
+            QVERIFY(delay >= max_delay / 2);
+            QVERIFY(delay <= max_delay);
+        }
+    }
+
+    // the delays are spread, not all the same
+    QSet<int> delays;
+    for (int i = 0; i < 100; i++) {
+        delays.insert(retryBackoffDelay(3));
+    }
+    QVERIFY(delays.size() > 1);
+}
+
+QTEST_APPLESS_MAIN(ApiRetryTest)
@@ -0,0 +1,19 @@
+#ifndef TESTS_API_RETRY_H
+#define TESTS_API_RETRY_H
+#include <QObject>
+
+class ApiRetryTest : public QObject {
+    Q_OBJECT
+public:
+    virtual ~ApiRetryTest() {};
+
+private slots:
+    void testRetryAfterSeconds();
+    void testRetryAfterDate();
+    void testRetryAfterPastDate();
+    void testRetryAfterCap();
+    void testRetryAfterInvalid();
+    void testBackoffDelay();
+};
+
+#endif // TESTS_API_RETRY_H
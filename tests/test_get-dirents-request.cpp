@@ -0,0 +1,170 @@
+#include "test_get-dirents-request.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtTest/QtTest>
+
+#include "../src/account.h"
+#include "../src/filebrowser/file-browser-requests.h"
+
+namespace {
+
+const char *kRepoId = "6f1a2b3c-4d5e-6f70-8192-a3b4c5d6e7f8";
+const char *kOldDirId = "1111111111111111111111111111111111111111";
+const char *kNewDirId = "2222222222222222222222222222222222222222";
+const char *kDirents =
+    "[{\"id\": \"3333333333333333333333333333333333333333\", \"type\": \"file\","
+    " \"name\": \"report.pdf\", \"size\": 1024, \"mtime\": 1444000000},"
+    " {\"id\": \"4444444444444444444444444444444444444444\", \"type\": \"dir\","
+    " \"name\": \"photos\", \"mtime\": 1444000000}]";
+const int kTimeoutMSecs = 10000;
+
+// Send the request and wait until it has emitted one of its signals
+void sendAndWait(GetDirentsRequest *req, DirentsReceiver *receiver)
+{
+    QObject::connect(req, SIGNAL(success(const QList<SeafDirent>&)),
+                     receiver, SLOT(onSuccess(const QList<SeafDirent>&)));
+    QObject::connect(req, SIGNAL(notModified()),
+                     receiver, SLOT(onNotModified()));
+    QObject::connect(req, SIGNAL(failed(const ApiError&)),
+                     receiver, SLOT(onFailed(const ApiError&)));
+
+    QEventLoop loop;
+    QObject::connect(receiver, SIGNAL(done()), &loop, SLOT(quit()));
+    QTimer::singleShot(kTimeoutMSecs, &loop, SLOT(quit()));
+    req->send();
+    loop.exec();
+}
+
+} // namespace
+
+bool StandInServer::listen()
+{
+    connect(&server_, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    return server_.listen(QHostAddress::LocalHost);
+}
+
+void StandInServer::setResponse(const QByteArray& dir_id, const QByteArray& body)
+{
+    dir_id_ = dir_id;
+    body_ = body;
+}
+
+void StandInServer::onNewConnection()
+{
+    while (server_.hasPendingConnections()) {
+        QTcpSocket *socket = server_.nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void StandInServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+    socket->setProperty("request", request);
+    // a GET has no body, it ends with its headers
+    if (!request.contains("\r\n\r\n")) {
+        return;
+    }
+
+    // "GET <url> HTTP/1.1"
+    requested_urls_.push_back(request.left(request.indexOf("\r\n")).split(' ').value(1));
+
+    QByteArray response = "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Connection: close\r\n"
+        "oid: " + dir_id_ + "\r\n"
+        "Content-Length: " + QByteArray::number(body_.size()) + "\r\n"
+        "\r\n" + body_;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+void DirentsReceiver::onSuccess(const QList<SeafDirent>& received)
+{
+    successes++;
+    dirents = received;
+    emit done();
+}
+
+void DirentsReceiver::onNotModified()
+{
+    not_modified++;
+    emit done();
+}
+
+void DirentsReceiver::onFailed(const ApiError& /* error */)
+{
+    failures++;
+    emit done();
+}
+
+void GetDirentsRequestTest::initTestCase() {
+    QVERIFY(server_.listen());
+}
+
+void GetDirentsRequestTest::testSendsKnownDirId() {
+    Account account(QUrl(QString("http://127.0.0.1:%1/").arg(server_.port())),
+                    "test@example.com", "token");
+    server_.setResponse(kOldDirId, "\"uptodate\"");
+
+    GetDirentsRequest req(account, kRepoId, "/docs", kOldDirId);
+    DirentsReceiver receiver;
+    sendAndWait(&req, &receiver);
+
+    QVERIFY(!server_.requestedUrls().isEmpty());
+    QByteArray url = server_.requestedUrls().last();
+    QVERIFY(url.startsWith(QByteArray("/api2/repos/") + kRepoId + "/dir/"));
+    QVERIFY(url.contains(QByteArray("oid=") + kOldDirId));
+
+    // without a known dir id there is nothing to revalidate
+    GetDirentsRequest fresh(account, kRepoId, "/docs");
+    DirentsReceiver fresh_receiver;
+    server_.setResponse(kOldDirId, kDirents);
+    sendAndWait(&fresh, &fresh_receiver);
+    QVERIFY(!server_.requestedUrls().last().contains("oid="));
+    QVERIFY(fresh_receiver.successes == 1);
+}
+
+void GetDirentsRequestTest::testNotModified() {
+    Account account(QUrl(QString("http://127.0.0.1:%1/").arg(server_.port())),
+                    "test@example.com", "token");
+    server_.setResponse(kOldDirId, "\"uptodate\"");
+
+    GetDirentsRequest req(account, kRepoId, "/notmodified", kOldDirId);
+    DirentsReceiver receiver;
+    sendAndWait(&req, &receiver);
+
+    QVERIFY(receiver.not_modified == 1);
+    QVERIFY(receiver.successes == 0);
+    QVERIFY(receiver.failures == 0);
+    QVERIFY(req.dirId() == kOldDirId);
+}
+
+void GetDirentsRequestTest::testModified() {
+    Account account(QUrl(QString("http://127.0.0.1:%1/").arg(server_.port())),
+                    "test@example.com", "token");
+    server_.setResponse(kNewDirId, kDirents);
+
+    GetDirentsRequest req(account, kRepoId, "/modified", kOldDirId);
+    DirentsReceiver receiver;
+    sendAndWait(&req, &receiver);
+
+    QVERIFY(receiver.successes == 1);
+    QVERIFY(receiver.not_modified == 0);
+    QVERIFY(req.dirId() == kNewDirId);
+    QVERIFY(receiver.dirents.size() == 2);
+    QVERIFY(receiver.dirents[0].name == "report.pdf");
+    QVERIFY(receiver.dirents[1].isDir());
+}
+
+// the requests only need an event loop, not a QApplication
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    GetDirentsRequestTest test;
+    return QTest::qExec(&test, argc, argv);
+}
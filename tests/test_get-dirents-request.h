@@ -0,0 +1,72 @@
+#ifndef TESTS_GET_DIRENTS_REQUEST_H
+#define TESTS_GET_DIRENTS_REQUEST_H
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QTcpServer>
+
+#include "../src/api/api-error.h"
+#include "../src/filebrowser/seaf-dirent.h"
+
+class QTcpSocket;
+
+/**
+ * A stand-in for seahub, which answers every request with the same "oid"
+ * header and body, and records the requested urls
+ */
+class StandInServer : public QObject {
+    Q_OBJECT
+public:
+    bool listen();
+    quint16 port() const { return server_.serverPort(); }
+
+    void setResponse(const QByteArray& dir_id, const QByteArray& body);
+    const QList<QByteArray>& requestedUrls() const { return requested_urls_; }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    QTcpServer server_;
+    QByteArray dir_id_;
+    QByteArray body_;
+    QList<QByteArray> requested_urls_;
+};
+
+// Record the signals of a GetDirentsRequest
+class DirentsReceiver : public QObject {
+    Q_OBJECT
+public:
+    DirentsReceiver() : successes(0), not_modified(0), failures(0) {}
+
+    int successes;
+    int not_modified;
+    int failures;
+    QList<SeafDirent> dirents;
+
+public slots:
+    void onSuccess(const QList<SeafDirent>& dirents);
+    void onNotModified();
+    void onFailed(const ApiError& error);
+
+signals:
+    void done();
+};
+
+class GetDirentsRequestTest : public QObject {
+    Q_OBJECT
+public:
+    virtual ~GetDirentsRequestTest() {};
+
+private slots:
+    void initTestCase();
+    void testSendsKnownDirId();
+    void testNotModified();
+    void testModified();
+
+private:
+    StandInServer server_;
+};
+
+#endif // TESTS_GET_DIRENTS_REQUEST_H
@@ -0,0 +1,96 @@
+#include "test_json-stream-parser.h"
+#include <string.h>
+#include <QList>
+#include <QtTest/QtTest>
+
+#include "../src/api/json-stream-parser.h"
+
+namespace {
+
+// more than the worker threads of the parsers
+const int kBlockedParsers = 8;
+
+QByteArray document()
+{
+    QByteArray data = "[";
+    for (int i = 0; i < 1000; i++) {
+        if (i > 0) {
+            data += ",";
+        }
+        data += "{\"id\": " + QByteArray::number(i) + ", \"name\": \"repo\"}";
+    }
+    data += "]";
+    return data;
+}
+
+// Feed the document in chunks of the given size and check the parsed json
+bool parseInChunks(JsonStreamParser *parser, const QByteArray& data, int chunk_size)
+{
+    for (int i = 0; i < data.size(); i += chunk_size) {
+        parser->feed(data.mid(i, chunk_size));
+    }
+    json_error_t error;
+    json_t *json = parser->finish(&error);
+    if (!json) {
+        return false;
+    }
+    bool ok = json_is_array(json) && json_array_size(json) == 1000
+        && json_integer_value(json_object_get(json_array_get(json, 999), "id")) == 999;
+    json_decref(json);
+    return ok;
+}
+
+} // namespace
+
+void JsonStreamParserTest::testChunkedFeed() {
+    QByteArray data = document();
+
+    JsonStreamParser one_chunk;
+    QVERIFY(parseInChunks(&one_chunk, data, data.size()));
+
+    JsonStreamParser small_chunks;
+    QVERIFY(parseInChunks(&small_chunks, data, 7));
+
+    // with nothing fed at all
+    JsonStreamParser empty;
+    json_error_t error;
+    QVERIFY(empty.finish(&error) == NULL);
+}
+
+void JsonStreamParserTest::testInvalidJson() {
+    JsonStreamParser parser;
+    parser.feed("{\"id\": ");
+    parser.feed("1,");
+    json_error_t error;
+    QVERIFY(parser.finish(&error) == NULL);
+    QVERIFY(strlen(error.text) > 0);
+}
+
+void JsonStreamParserTest::testFinishWithoutWorker() {
+    // keep all the worker threads waiting for their data, so the last
+    // parsers are parsed by finish
+    QList<JsonStreamParser *> blocked;
+    for (int i = 0; i < kBlockedParsers; i++) {
+        blocked.push_back(new JsonStreamParser);
+        blocked.back()->feed("[1, ");
+    }
+
+    JsonStreamParser parser;
+    QVERIFY(parseInChunks(&parser, document(), 100));
+
+    qDeleteAll(blocked);
+}
+
+void JsonStreamParserTest::testDestroyWhileParsing() {
+    for (int i = 0; i < kBlockedParsers; i++) {
+        JsonStreamParser *parser = new JsonStreamParser;
+        parser->feed("[1, 2, ");
+        delete parser;
+    }
+
+    // the worker threads have been released by the deleted parsers
+    JsonStreamParser parser;
+    QVERIFY(parseInChunks(&parser, document(), 1000));
+}
+
+QTEST_APPLESS_MAIN(JsonStreamParserTest)
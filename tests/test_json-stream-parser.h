@@ -0,0 +1,17 @@
+#ifndef TESTS_JSON_STREAM_PARSER_H
+#define TESTS_JSON_STREAM_PARSER_H
+#include <QObject>
+
+class JsonStreamParserTest : public QObject {
+    Q_OBJECT
+public:
+    virtual ~JsonStreamParserTest() {};
+
+private slots:
+    void testChunkedFeed();
+    void testInvalidJson();
+    void testFinishWithoutWorker();
+    void testDestroyWhileParsing();
+};
+
+#endif // TESTS_JSON_STREAM_PARSER_H
@@ -0,0 +1,132 @@
+#include "test_mapped-file-device.h"
+#include <QtTest/QtTest>
+
+#include "../src/utils/mapped-file-device.h"
+
+namespace {
+
+// spans several map windows
+const int kFileSize = 80 * 1024 * 1024 + 12345;
+// the size of the reads done by QHttpMultiPart
+const int kReadSize = 16 * 1024;
+
+QByteArray readAll(QIODevice *device)
+{
+    QByteArray data;
+    char buf[kReadSize];
+    qint64 n;
+    while ((n = device->read(buf, sizeof(buf))) > 0) {
+        data.append(buf, n);
+    }
+    return data;
+}
+
+// read through the device without keeping the data
+qint64 drain(QIODevice *device)
+{
+    qint64 total = 0;
+    char buf[kReadSize];
+    qint64 n;
+    while ((n = device->read(buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    return total;
+}
+
+} // namespace
+
+void MappedFileDeviceTest::initTestCase() {
+    content_.resize(kFileSize);
+    qsrand(42);
+    for (int i = 0; i < kFileSize; i++) {
+        content_[i] = (char)qrand();
+    }
+    QVERIFY(file_.open());
+    QVERIFY(file_.write(content_) == kFileSize);
+    file_.close();
+}
+
+void MappedFileDeviceTest::testRead() {
+    MappedFileDevice device(file_.fileName());
+    QVERIFY(device.open(QIODevice::ReadOnly));
+    QVERIFY(device.isMapped());
+    QVERIFY(device.size() == kFileSize);
+    QVERIFY(readAll(&device) == content_);
+    QVERIFY(device.atEnd());
+}
+
+void MappedFileDeviceTest::testSeek() {
+    MappedFileDevice device(file_.fileName());
+    QVERIFY(device.open(QIODevice::ReadOnly));
+
+    const qint64 offsets[] = { 0, 1, 65535, 32 * 1024 * 1024 - 1,
+                               kFileSize - 100, 1000 };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        QVERIFY(device.seek(offsets[i]));
+        QByteArray data = device.read(kReadSize);
+        QVERIFY(data == content_.mid(offsets[i], kReadSize));
+    }
+
+    QVERIFY(device.reset());
+    QVERIFY(readAll(&device) == content_);
+}
+
+void MappedFileDeviceTest::testSmallFile() {
+    QTemporaryFile small;
+    QVERIFY(small.open());
+    QByteArray content = content_.left(100 * 1000);
+    small.write(content);
+    small.close();
+
+    MappedFileDevice device(small.fileName());
+    QVERIFY(device.open(QIODevice::ReadOnly));
+    QVERIFY(!device.isMapped());
+    QVERIFY(readAll(&device) == content);
+    QVERIFY(device.seek(70000));
+    QVERIFY(device.read(kReadSize) == content.mid(70000, kReadSize));
+}
+
+void MappedFileDeviceTest::testMapDisabled() {
+    MappedFileDevice device(file_.fileName());
+    device.setMapEnabled(false);
+    QVERIFY(device.open(QIODevice::ReadOnly));
+    QVERIFY(!device.isMapped());
+    QVERIFY(readAll(&device) == content_);
+}
+
+void MappedFileDeviceTest::testTruncated() {
+    QTemporaryFile truncated;
+    QVERIFY(truncated.open());
+    QByteArray content = content_.left(4 * 1024 * 1024);
+    truncated.write(content);
+    truncated.flush();
+
+    MappedFileDevice device(truncated.fileName());
+    QVERIFY(device.open(QIODevice::ReadOnly));
+    QVERIFY(device.isMapped());
+    QVERIFY(device.read(1024 * 1024) == content.left(1024 * 1024));
+
+    // reading past the new end from the mapping would crash
+    QVERIFY(truncated.resize(2 * 1024 * 1024));
+    QByteArray rest = readAll(&device);
+    QVERIFY(!device.isMapped());
+    QVERIFY(rest == content.mid(1024 * 1024, 1024 * 1024));
+}
+
+void MappedFileDeviceTest::benchmarkQFile() {
+    QBENCHMARK {
+        QFile device(file_.fileName());
+        device.open(QIODevice::ReadOnly);
+        QVERIFY(drain(&device) == kFileSize);
+    }
+}
+
+void MappedFileDeviceTest::benchmarkMappedFileDevice() {
+    QBENCHMARK {
+        MappedFileDevice device(file_.fileName());
+        device.open(QIODevice::ReadOnly);
+        QVERIFY(drain(&device) == kFileSize);
+    }
+}
+
+QTEST_APPLESS_MAIN(MappedFileDeviceTest)
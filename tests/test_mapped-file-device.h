@@ -0,0 +1,26 @@
+#ifndef TESTS_MAPPED_FILE_DEVICE_H
+#define TESTS_MAPPED_FILE_DEVICE_H
+#include <QObject>
+#include <QTemporaryFile>
+
+class MappedFileDeviceTest : public QObject {
+    Q_OBJECT
+public:
+    virtual ~MappedFileDeviceTest() {};
+
+private slots:
+    void initTestCase();
+    void testRead();
+    void testSeek();
+    void testSmallFile();
+    void testMapDisabled();
+    void testTruncated();
+    void benchmarkQFile();
+    void benchmarkMappedFileDevice();
+
+private:
+    QTemporaryFile file_;
+    QByteArray content_;
+};
+
+#endif // TESTS_MAPPED_FILE_DEVICE_H